@@ -137,12 +137,11 @@ void music_control::refresh_play_state()
     ui->btn_play_pause->setIcon(QIcon(icon));
 
     /* refresh song info */
-    if (copy.get(meta::TITLE) != last_title) {
+    auto derived = copy.derived();
+    if (derived->title != last_title) {
         QString info = utf8_to_qt(T_DOCK_SONG_INFO);
         if (copy.get<int>(meta::STATUS) <= state_paused) {
-            last_title = copy.get(meta::TITLE);
-            QString artists, title = copy.get(meta::TITLE);
-            artists = copy.get<QStringList>(meta::ARTIST).join(", ");
+            QString artists = derived->artists, title = derived->title;
             // Icecast and window title don't provide these
             if (!artists.isEmpty()) {
                 info.append(artists);
@@ -67,6 +67,7 @@ tuna_gui::tuna_gui(QWidget* parent)
     ADD_SIGNAL(btn_start);
     ADD_SIGNAL(btn_stop);
     ADD_SIGNAL(btn_browse_song_lyrics);
+    ADD_SIGNAL(btn_browse_lyrics_line);
 
 #undef ADD_SIGNAL
 
@@ -108,23 +109,31 @@ tuna_gui::tuna_gui(QWidget* parent)
             ui->cb_cover_size->setCurrentIndex(i);
         i++;
     }
-    ui->cb_cover_size->addItem(T_LARGEST_COVER, 8129);
+    ui->cb_cover_size->addItem(T_LARGEST_COVER, LARGEST_COVER);
 
-    if (config::cover_size == 8129)
+    if (config::cover_size == LARGEST_COVER)
         ui->cb_cover_size->setCurrentIndex(i);
 
     connect(ui->cb_dl_lyrics, &QCheckBox::stateChanged, this, [this](int s) {
         ui->frame_lyrics->setEnabled(s == Qt::CheckState::Checked);
+        ui->frame_lyrics_sync->setEnabled(s == Qt::CheckState::Checked);
     });
 
     connect(ui->cb_dl_cover, &QCheckBox::stateChanged, this, [this](int s) {
         ui->cb_download_missing->setEnabled(s == Qt::CheckState::Checked);
-        ui->cb_cover_size->setEnabled(s == Qt::CheckState::Checked && ui->cb_download_missing->isChecked());
+        ui->cb_normalize_cover->setEnabled(s == Qt::CheckState::Checked);
+        ui->cb_blur_cover->setEnabled(s == Qt::CheckState::Checked);
+        ui->cb_write_cover->setEnabled(s == Qt::CheckState::Checked);
+        update_cover_size_state();
         ui->frame_cover->setEnabled(s == Qt::CheckState::Checked);
     });
 
-    connect(ui->cb_download_missing, &QCheckBox::stateChanged, this, [this](int s) {
-        ui->cb_cover_size->setEnabled(s == Qt::CheckState::Checked);
+    connect(ui->cb_download_missing, &QCheckBox::stateChanged, this, [this](int) {
+        update_cover_size_state();
+    });
+
+    connect(ui->cb_normalize_cover, &QCheckBox::stateChanged, this, [this](int) {
+        update_cover_size_state();
     });
 }
 
@@ -157,17 +166,26 @@ void tuna_gui::toggleShowHide()
         /* load basic values */
         ui->txt_song_cover->setText(config::cover_path);
         ui->txt_song_lyrics->setText(config::lyrics_path);
+        ui->txt_lyrics_line->setText(config::lyrics_line_path);
+        ui->txt_lyrics_provider->setText(config::lyrics_provider);
         ui->sb_refresh_rate->setValue(config::refresh_rate);
         ui->txt_song_placeholder->setText(config::placeholder);
         ui->cb_dl_lyrics->setChecked(config::download_lyrics);
         ui->cb_dl_cover->setChecked(config::download_cover);
         ui->cb_download_missing->setChecked(config::download_missing_cover);
+        ui->cb_normalize_cover->setChecked(config::normalize_cover);
+        ui->cb_blur_cover->setChecked(config::blur_cover);
+        ui->cb_write_cover->setChecked(config::write_cover);
         auto idx = ui->cb_source->findData(config::selected_source);
 
         ui->frame_lyrics->setEnabled(ui->cb_dl_lyrics->isChecked());
+        ui->frame_lyrics_sync->setEnabled(ui->cb_dl_lyrics->isChecked());
         ui->frame_cover->setEnabled(ui->cb_dl_cover->isChecked());
         ui->cb_download_missing->setEnabled(ui->cb_dl_cover->isChecked());
-        ui->cb_cover_size->setEnabled(ui->cb_dl_cover->isChecked() && ui->cb_download_missing->isChecked());
+        ui->cb_normalize_cover->setEnabled(ui->cb_dl_cover->isChecked());
+        ui->cb_blur_cover->setEnabled(ui->cb_dl_cover->isChecked());
+        ui->cb_write_cover->setEnabled(ui->cb_dl_cover->isChecked());
+        update_cover_size_state();
 
         if (idx >= 0)
             ui->cb_source->setCurrentIndex(idx);
@@ -175,6 +193,7 @@ void tuna_gui::toggleShowHide()
             ui->cb_source->setCurrentIndex(0);
         ui->cb_host_server->setChecked(config::webserver_enabled);
         ui->sb_web_port->setValue(config::webserver_port);
+        ui->txt_cover_variants->setText(config::cover_variants_to_string());
         ui->cb_remove_file_extensions->setChecked(config::remove_file_extensions);
         set_state();
 
@@ -222,13 +241,19 @@ void tuna_gui::tuna_gui_accepted()
     config::selected_source = qt_to_utf8(ui->cb_source->currentData().toString());
     config::cover_path = qt_to_utf8(ui->txt_song_cover->text());
     config::lyrics_path = qt_to_utf8(ui->txt_song_lyrics->text());
+    config::lyrics_line_path = ui->txt_lyrics_line->text();
+    config::lyrics_provider = ui->txt_lyrics_provider->text().trimmed();
     config::refresh_rate = ui->sb_refresh_rate->value();
     config::placeholder = qt_to_utf8(ui->txt_song_placeholder->text());
     config::download_lyrics = ui->cb_dl_lyrics->isChecked();
     config::download_cover = ui->cb_dl_cover->isChecked();
     config::download_missing_cover = ui->cb_download_missing->isChecked();
+    config::normalize_cover = ui->cb_normalize_cover->isChecked();
+    config::blur_cover = ui->cb_blur_cover->isChecked();
+    config::write_cover = ui->cb_write_cover->isChecked();
     config::webserver_enabled = ui->cb_host_server->isChecked();
     config::webserver_port = ui->sb_web_port->value();
+    config::cover_variants = config::parse_cover_variants(ui->txt_cover_variants->text());
     config::remove_file_extensions = ui->cb_remove_file_extensions->isChecked();
     config::cover_size = ui->cb_cover_size->currentData().toInt();
     config::refresh_rate = ui->sb_refresh_rate->value();
@@ -294,6 +319,14 @@ void tuna_gui::btn_browse_song_lyrics_clicked()
         ui->txt_song_lyrics->setText(path);
 }
 
+void tuna_gui::btn_browse_lyrics_line_clicked()
+{
+    QString path;
+    choose_file(path, T_SELECT_LYRICS_LINE, FILTER("Text file", "*.txt"));
+    if (!path.isEmpty())
+        ui->txt_lyrics_line->setText(path);
+}
+
 void tuna_gui::add_output(const QString& format, const QString& path, bool log_mode)
 {
     int row = ui->tbl_outputs->rowCount();
@@ -353,7 +386,14 @@ void tuna_gui::btn_edit_output_clicked()
     }
 }
 
-void tuna_gui::cb_download_missing_covers_clicked(int state)
+void tuna_gui::cb_download_missing_covers_clicked(int)
+{
+    update_cover_size_state();
+}
+
+void tuna_gui::update_cover_size_state()
 {
-    ui->cb_cover_size->setEnabled(state == Qt::CheckState::Checked);
+    /* The size is used both for covers from itunes and for scaling covers */
+    ui->cb_cover_size->setEnabled(ui->cb_dl_cover->isChecked()
+        && (ui->cb_download_missing->isChecked() || ui->cb_normalize_cover->isChecked()));
 }
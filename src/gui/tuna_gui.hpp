@@ -67,6 +67,7 @@ private slots:
     void btn_stop_clicked();
     void btn_browse_song_cover_clicked();
     void btn_browse_song_lyrics_clicked();
+    void btn_browse_lyrics_line_clicked();
     void btn_add_output_clicked();
     void btn_remove_output_clicked();
     void btn_edit_output_clicked();
@@ -74,6 +75,7 @@ private slots:
 
 private:
     void choose_file(QString& path, const char* title, const char* file_types);
+    void update_cover_size_state();
     Ui::tuna_gui* ui;
 };
 
@@ -0,0 +1,80 @@
+/*************************************************************************
+ * This file is part of tuna
+ * git.vrsal.xyz/alex/tuna
+ * Copyright 2023 univrsal <uni@vrsal.xyz>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#include "auto_select.hpp"
+#include "../../query/music_source.hpp"
+#include "../../util/config.hpp"
+#include "../../util/constants.hpp"
+#include "../../util/utility.hpp"
+#include "ui_auto_select.h"
+#include <QListWidgetItem>
+
+auto_select::auto_select(QWidget* parent)
+    : source_widget(parent)
+    , ui(new Ui::auto_select)
+{
+    ui->setupUi(this);
+}
+
+auto_select::~auto_select()
+{
+    delete ui;
+}
+
+void auto_select::load_settings()
+{
+    auto ids = utf8_to_qt(CGET_STR(CFG_AUTO_SOURCES)).split(';', Qt::SkipEmptyParts);
+    for (auto& id : ids)
+        id = id.trimmed();
+
+    QStringList added;
+    auto add_item = [this, &added](music_source* src, bool checked) {
+        added.append(utf8_to_qt(src->id()));
+        auto* item = new QListWidgetItem(utf8_to_qt(src->name()), ui->lst_sources);
+        item->setData(Qt::UserRole, utf8_to_qt(src->id()));
+        item->setFlags(item->flags() | Qt::ItemIsUserCheckable);
+        item->setCheckState(checked ? Qt::Checked : Qt::Unchecked);
+    };
+
+    /* Selected sources first in their priority order, then all others */
+    ui->lst_sources->clear();
+    for (auto const& id : std::as_const(ids)) {
+        auto src = music_sources::get<music_source>(qt_to_utf8(id));
+        if (src && id != S_SOURCE_AUTO && !added.contains(id))
+            add_item(src.get(), true);
+    }
+    for (auto const& src : std::as_const(music_sources::instances)) {
+        auto id = utf8_to_qt(src->id());
+        if (id != S_SOURCE_AUTO && !added.contains(id))
+            add_item(src.get(), false);
+    }
+
+    ui->sb_switch_delay->setValue(CGET_UINT(CFG_AUTO_SWITCH_DELAY));
+}
+
+void auto_select::save_settings()
+{
+    QStringList ids;
+    for (int i = 0; i < ui->lst_sources->count(); i++) {
+        auto* item = ui->lst_sources->item(i);
+        if (item->checkState() == Qt::Checked)
+            ids.append(item->data(Qt::UserRole).toString());
+    }
+    CSET_STR(CFG_AUTO_SOURCES, qt_to_utf8(ids.join(';')));
+    CSET_UINT(CFG_AUTO_SWITCH_DELAY, ui->sb_switch_delay->value());
+}
@@ -37,9 +37,13 @@ icecast::~icecast()
 void icecast::load_settings()
 {
     ui->txt_icecast_url->setText(utf8_to_qt(CGET_STR(CFG_ICECAST_URL)));
+    ui->txt_icecast_mount->setText(utf8_to_qt(CGET_STR(CFG_ICECAST_MOUNT)));
+    ui->cb_use_icy->setChecked(CGET_BOOL(CFG_ICECAST_USE_ICY));
 }
 
 void icecast::save_settings()
 {
     CSET_STR(CFG_ICECAST_URL, qt_to_utf8(ui->txt_icecast_url->text()));
+    CSET_STR(CFG_ICECAST_MOUNT, qt_to_utf8(ui->txt_icecast_mount->text()));
+    CSET_BOOL(CFG_ICECAST_USE_ICY, ui->cb_use_icy->isChecked());
 }
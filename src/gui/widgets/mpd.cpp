@@ -41,6 +41,7 @@ void mpd::load_settings()
     ui->txt_ip->setText(utf8_to_qt(CGET_STR(CFG_MPD_IP)));
     ui->sb_port->setValue(CGET_INT(CFG_MPD_PORT));
     ui->txt_base_folder->setText(utf8_to_qt(CGET_STR(CFG_MPD_BASE_FOLDER)));
+    ui->txt_cover_names->setText(utf8_to_qt(CGET_STR(CFG_MPD_COVER_NAMES)));
 }
 
 void mpd::save_settings()
@@ -52,6 +53,7 @@ void mpd::save_settings()
     if (!path.endsWith("/"))
         path.append("/");
     CSET_STR(CFG_MPD_BASE_FOLDER, qt_to_utf8(path));
+    CSET_STR(CFG_MPD_COVER_NAMES, qt_to_utf8(ui->txt_cover_names->text()));
 }
 
 void mpd::on_rb_remote_toggled(bool remote)
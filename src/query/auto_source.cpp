@@ -0,0 +1,166 @@
+/*************************************************************************
+ * This file is part of tuna
+ * git.vrsal.xyz/alex/tuna
+ * Copyright 2023 univrsal <uni@vrsal.xyz>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#include "auto_source.hpp"
+#include "../gui/widgets/auto_select.hpp"
+#include "../util/config.hpp"
+#include "../util/constants.hpp"
+#include "../util/utility.hpp"
+#include <algorithm>
+#include <util/platform.h>
+
+static int rank(music_source* src)
+{
+    switch (src->song_info().get<int>(meta::STATUS)) {
+    case state_playing:
+        return 2;
+    case state_paused:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+auto_source::auto_source()
+    : music_source(S_SOURCE_AUTO, T_SOURCE_AUTO, new auto_select)
+{
+}
+
+void auto_source::load()
+{
+    CDEF_STR(CFG_AUTO_SOURCES, S_SOURCE_MPD ";" S_SOURCE_VLC ";" S_SOURCE_MPRIS ";" S_SOURCE_WMC ";" S_SOURCE_SPOTIFY);
+    CDEF_UINT(CFG_AUTO_SWITCH_DELAY, m_switch_delay);
+    music_source::load();
+
+    m_switch_delay = CGET_UINT(CFG_AUTO_SWITCH_DELAY);
+    auto ids = utf8_to_qt(CGET_STR(CFG_AUTO_SOURCES)).split(';', Qt::SkipEmptyParts);
+
+    m_sources.clear();
+    m_supported_metadata.fill(false);
+    for (auto const& id : std::as_const(ids)) {
+        auto src = music_sources::get<music_source>(qt_to_utf8(id.trimmed()));
+        if (!src || src.get() == this || std::find(m_sources.begin(), m_sources.end(), src.get()) != m_sources.end())
+            continue;
+        m_sources.push_back(src.get());
+
+        /* Any of the sources could be the active one */
+        for (int i = 0; i < meta::COUNT; i++) {
+            if (src->provides_metadata({ meta::type(i) }))
+                m_supported_metadata[i] = true;
+        }
+    }
+
+    if (std::find(m_sources.begin(), m_sources.end(), m_active.load()) == m_sources.end())
+        switch_to(nullptr);
+    m_candidate = nullptr;
+}
+
+void auto_source::switch_to(music_source* src)
+{
+    if (src == m_active)
+        return;
+    binfo("Automatic source selection switched to %s", src ? src->id() : "none");
+    m_active = src;
+    m_candidate = nullptr;
+    if (src)
+        src->invalidate();
+}
+
+void auto_source::select_active()
+{
+    /* Sources earlier in the list win ties */
+    music_source* best = nullptr;
+    int best_rank = -1;
+    for (auto src : m_sources) {
+        auto r = rank(src);
+        if (r > best_rank) {
+            best = src;
+            best_rank = r;
+        }
+    }
+
+    if (!m_active) {
+        switch_to(best);
+        return;
+    }
+
+    /* The active source is kept unless another one is strictly ahead of it */
+    if (best == m_active || best_rank <= rank(m_active.load())) {
+        m_candidate = nullptr;
+        return;
+    }
+
+    auto now = os_gettime_ns() / 1000000;
+    if (best != m_candidate) {
+        m_candidate = best;
+        m_candidate_since = now;
+    }
+    if (now - m_candidate_since >= m_switch_delay)
+        switch_to(best);
+}
+
+void auto_source::refresh()
+{
+    begin_refresh();
+    select_active();
+    if (auto* src = m_active.load()) {
+        m_current = src->song_info();
+        m_capabilities = src->get_capabilities();
+    } else {
+        m_current.clear();
+        m_capabilities = 0;
+    }
+}
+
+void auto_source::post_refresh()
+{
+    /* The song was already completed by the source it came from */
+    publish();
+}
+
+void auto_source::reset_info()
+{
+    music_source::reset_info();
+    for (auto src : m_sources)
+        src->reset_info();
+    m_active = nullptr;
+    m_candidate = nullptr;
+    m_capabilities = 0;
+}
+
+bool auto_source::execute_capability(capability c)
+{
+    auto* src = m_active.load();
+    return src && src->execute_capability(c);
+}
+
+void auto_source::handle_cover()
+{
+    if (auto* src = m_active.load())
+        src->handle_cover();
+    else
+        music_source::handle_cover();
+}
+
+void auto_source::handle_lyrics()
+{
+    if (auto* src = m_active.load())
+        src->handle_lyrics();
+    else
+        music_source::handle_lyrics();
+}
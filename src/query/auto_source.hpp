@@ -0,0 +1,57 @@
+/*************************************************************************
+ * This file is part of tuna
+ * git.vrsal.xyz/alex/tuna
+ * Copyright 2023 univrsal <uni@vrsal.xyz>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#pragma once
+#include "music_source.hpp"
+#include <atomic>
+#include <vector>
+
+/* Follows whichever of the configured sources is currently playing, the
+ * query thread refreshes them in parallel, each at its own cadence. Sources
+ * earlier in the list win if multiple start playing, and a new source only
+ * takes over once it has been ahead for the switch delay, so that short
+ * pauses or track changes don't make the output jump between sources */
+class auto_source : public music_source {
+    std::vector<music_source*> m_sources;
+    /* Also read by the GUI thread, e.g. for the music controls */
+    std::atomic<music_source*> m_active { nullptr };
+    music_source* m_candidate = nullptr;
+    uint64_t m_candidate_since = 0;
+    uint32_t m_switch_delay = 2000;
+
+    void select_active();
+    void switch_to(music_source* src);
+
+public:
+    auto_source();
+
+    void load() override;
+    void refresh() override;
+    std::vector<music_source*> polled_sources() override { return m_sources; }
+    void post_refresh() override;
+    void reset_info() override;
+    bool execute_capability(capability c) override;
+    bool enabled() const override { return true; }
+    void handle_cover() override;
+    void handle_lyrics() override;
+    music_source* active() override
+    {
+        auto* src = m_active.load();
+        return src ? src : this;
+    }
+};
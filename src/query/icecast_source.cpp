@@ -19,12 +19,103 @@
 #include "icecast_source.hpp"
 #include "../gui/widgets/icecast.hpp"
 #include "../util/config.hpp"
+#include "../util/json_stream.hpp"
+#include "../util/rate_limiter.hpp"
 #include "../util/utility.hpp"
 #include <QDateTime>
-#include <QJsonDocument>
-#include <QJsonObject>
+#include <QUrl>
 #include <curl/curl.h>
 
+/* The status page of relay servers can list hundreds of mounts, it's parsed
+ * while it's downloaded, but the transfer is cut off at this size */
+#define MAX_RESPONSE_SIZE (8 * 1024 * 1024)
+
+namespace {
+struct status_parser {
+    QString mount;
+    size_t received = 0;
+    size_t source_depth = 0;
+    bool in_source = false;
+    bool too_big = false;
+    bool found = false;
+    std::string listen_url, title, found_title;
+    util::json_stream json;
+
+    status_parser(const QString& m)
+        : mount(m)
+        , json([this](util::json_stream::event e, const util::json_stream& s) { return on_event(e, s); })
+    {
+    }
+
+    /* Sources are either icestats.source or icestats.source[n], depending
+     * on whether the server has one or multiple mounts */
+    static bool is_source(const util::json_stream& s)
+    {
+        auto& path = s.path();
+        if (path.size() < 3 || path.size() > 4 || path[1] != "icestats" || path[2] != "source")
+            return false;
+        return path.size() == 3 ? true : path[3].empty();
+    }
+
+    bool matches() const
+    {
+        /* Without a mount the first source with a title is used */
+        if (mount.isEmpty())
+            return !title.empty();
+        return QUrl(utf8_to_qt(listen_url)).path() == mount;
+    }
+
+    bool on_event(util::json_stream::event e, const util::json_stream& s)
+    {
+        switch (e) {
+        case util::json_stream::object_begin:
+            if (!in_source && is_source(s)) {
+                in_source = true;
+                source_depth = s.depth();
+                listen_url.clear();
+                title.clear();
+            }
+            break;
+        case util::json_stream::string:
+            if (in_source && s.depth() == source_depth) {
+                if (s.key() == "listenurl")
+                    listen_url = s.value();
+                else if (s.key() == "title")
+                    title = s.value();
+            }
+            break;
+        case util::json_stream::object_end:
+            if (in_source && s.depth() == source_depth) {
+                in_source = false;
+                if (matches()) {
+                    found = true;
+                    found_title = title;
+                    return false; /* No need to look at the rest */
+                }
+            }
+            break;
+        default:;
+        }
+        return true;
+    }
+};
+
+size_t status_write_callback(char* ptr, size_t size, size_t nmemb, status_parser* parser)
+{
+    size_t length = size * nmemb;
+    parser->received += length;
+    if (parser->received > MAX_RESPONSE_SIZE) {
+        parser->too_big = true;
+        return 0;
+    }
+
+    /* Returning less than the chunk size aborts the transfer */
+    if (!parser->json.feed(ptr, length))
+        return 0;
+    return length;
+}
+}
+
 icecast_source::icecast_source()
     : music_source(S_SOURCE_ICECAST, T_SOURCE_ICECAST, new icecast)
 {
@@ -35,63 +126,110 @@ void icecast_source::load()
 {
     music_source::load();
     CDEF_STR(CFG_ICECAST_URL, "");
-    m_url = utf8_to_qt(CGET_STR(CFG_ICECAST_URL)) + "/status-json.xsl";
-    m_logged_response_too_big = false;
+    CDEF_STR(CFG_ICECAST_MOUNT, "");
+    CDEF_BOOL(CFG_ICECAST_USE_ICY, false);
+    auto server = utf8_to_qt(CGET_STR(CFG_ICECAST_URL));
+    m_url = server + "/status-json.xsl";
+    m_mount = utf8_to_qt(CGET_STR(CFG_ICECAST_MOUNT)).trimmed();
+    if (!m_mount.isEmpty() && !m_mount.startsWith('/'))
+        m_mount.prepend('/');
+    m_stream_url = server.isEmpty() ? QString() : server + m_mount;
+
+    /* Settings might have changed, the reader connects again on the next refresh */
+    m_use_icy = CGET_BOOL(CFG_ICECAST_USE_ICY);
+    m_icy.stop();
+}
+
+void icecast_source::reset_info()
+{
+    music_source::reset_info();
+    m_icy.stop();
+}
+
+bool icecast_source::should_log()
+{
+    /* Errors are most likely persistent, so don't spam the log every poll */
+    auto epoch = QDateTime::currentSecsSinceEpoch();
+    if (m_last_log == 0 || epoch - m_last_log > 10) {
+        m_last_log = epoch;
+        return true;
+    }
+    return false;
+}
+
+refresh_cadence icecast_source::cadence() const
+{
+    return { config::refresh_rate, 1000, false };
 }
 
 void icecast_source::refresh()
 {
     static char error_buffer[CURL_ERROR_SIZE];
 
-    if (m_logged_response_too_big || m_url.isEmpty())
+    /* The stream itself tells us when the title changes, so there's nothing
+     * to request here */
+    if (m_use_icy) {
+        begin_refresh();
+        m_icy.start(m_stream_url);
+        auto title = m_icy.title();
+        if (!title.isEmpty()) {
+            m_current.set(meta::TITLE, title);
+            m_current.set(meta::STATUS, state_playing);
+        }
+        return;
+    }
+
+    if (m_url.isEmpty() || !rate_limiter::acquire(m_url))
         return;
 
     begin_refresh();
     auto* curl = curl_easy_init();
     if (curl) {
         error_buffer[0] = '\0';
-        std::string response;
+        status_parser parser(m_mount);
+        std::string header;
+        long http_code = -1;
         curl_easy_setopt(curl, CURLOPT_URL, qt_to_utf8(m_url));
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, util::write_callback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, status_write_callback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &parser);
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, util::write_callback);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, &header);
         curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, error_buffer);
         auto result = curl_easy_perform(curl);
+
+        /* An aborted transfer is expected once the mount was found */
+        bool aborted = result == CURLE_WRITE_ERROR && (parser.found || parser.too_big || parser.json.failed());
+        if (result == CURLE_OK || aborted)
+            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
         curl_easy_cleanup(curl);
+        rate_limiter::report(m_url, http_code, header);
 
-        if (result == CURLE_OK) {
-            // Pretty arbitrary, but I have tested this with some stations
-            // and they respond with ~1MB of data which we will not parse
-            if (response.length() > 1024 * 512) {
-                m_logged_response_too_big = true;
-                berr("The IceCast server at %s responded with %zu bytes of data "
-                     "which is too long and therefore will not be processed",
-                    qt_to_utf8(m_url), response.length());
-                return;
-            }
-            QJsonParseError err;
-            auto doc = QJsonDocument::fromJson(response.c_str(), &err);
-
-            if (doc.isNull() || !doc.isObject()) {
-                berr("Failed to parse json response from IceCast server: %s", qt_to_utf8(err.errorString()));
-            } else {
-                auto stats = doc.object()["icestats"].toObject();
-                if (!stats.isEmpty()) {
-                    auto source = stats["source"].toObject();
-                    if (source["title"].isString()) {
-                        m_current.set(meta::TITLE, source["title"].toString());
-                        m_current.set(meta::STATUS, state_playing);
-                    }
-                }
-            }
-        } else {
-            auto epoch = QDateTime::currentSecsSinceEpoch();
-            if (m_last_log == 0 || m_last_log - epoch > 10) {
-                m_last_log = epoch;
-                berr("Failed to retrieve information from IceCast server %s: cURL error '%s' (%i)",
-                    qt_to_utf8(m_url), curl_easy_strerror(result), result);
-                if (strlen(error_buffer) > 0)
-                    berr("Additional curl error message: %s", error_buffer);
+        if (result == CURLE_OK || aborted) {
+            if (http_code != HTTP_OK) {
+                if (should_log())
+                    berr("Received error code %i from IceCast server %s", int(http_code), qt_to_utf8(m_url));
+            } else if (parser.too_big) {
+                // Only this poll is skipped, the next one might be smaller
+                if (should_log())
+                    berr("The IceCast server at %s responded with more than %i bytes of data "
+                         "without listing the mount, the response was not processed completely",
+                        qt_to_utf8(m_url), MAX_RESPONSE_SIZE);
+            } else if (parser.json.failed()) {
+                if (should_log())
+                    berr("Failed to parse json response from IceCast server %s: %s",
+                        qt_to_utf8(m_url), parser.json.error().c_str());
+            } else if (parser.found && !parser.found_title.empty()) {
+                m_current.set(meta::TITLE, utf8_to_qt(parser.found_title.c_str()));
+                m_current.set(meta::STATUS, state_playing);
+            } else if (!parser.found && !m_mount.isEmpty()) {
+                if (should_log())
+                    berr("The IceCast server at %s doesn't list the mount %s", qt_to_utf8(m_url), qt_to_utf8(m_mount));
             }
+        } else if (should_log()) {
+            berr("Failed to retrieve information from IceCast server %s: cURL error '%s' (%i)",
+                qt_to_utf8(m_url), curl_easy_strerror(result), result);
+            if (strlen(error_buffer) > 0)
+                berr("Additional curl error message: %s", error_buffer);
         }
     }
 }
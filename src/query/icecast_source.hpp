@@ -18,19 +18,27 @@
 
 #pragma once
 #include "../util/constants.hpp"
+#include "../util/icy_reader.hpp"
 #include "music_source.hpp"
 #include <QString>
 
 class icecast_source : public music_source {
     QString m_url {};
+    QString m_mount {};
+    QString m_stream_url {};
     qint64 m_last_log {};
-    bool m_logged_response_too_big { false };
+    bool m_use_icy { false };
+    util::icy_reader m_icy;
+
+    bool should_log();
 
 public:
     icecast_source();
 
     void load() override;
     void refresh() override;
+    refresh_cadence cadence() const override;
+    void reset_info() override;
     bool execute_capability(capability) override { return false; };
     bool enabled() const override { return true; };
 };
@@ -19,8 +19,8 @@
 #include "lastfm_source.hpp"
 #include "../gui/widgets/lastfm.hpp"
 #include "../util/config.hpp"
+#include "../util/rate_limiter.hpp"
 #include "../util/utility.hpp"
-#include "util/platform.h"
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
@@ -28,7 +28,21 @@
 #include <QUrl>
 #include <curl/curl.h>
 
-long lastfm_request(QJsonDocument& response_json, const QString& url);
+#define LASTFM_HOST "ws.audioscrobbler.com"
+
+long lastfm_request(QJsonDocument& response_json, const QString& url, std::string& header, const std::string& etag, const std::string& last_modified);
+
+/* Name, artist and either the scrobble time or the now playing flag identify
+ * a single entry in the recent tracks list */
+static QString track_identity(const QJsonObject& s)
+{
+    QString id = s["name"].toString() + '\n' + s["artist"].toObject()["#text"].toString() + '\n';
+    if (s["@attr"].toObject()["nowplaying"].toString() == "true")
+        id += "nowplaying";
+    else
+        id += s["date"].toObject()["uts"].toString();
+    return id;
+}
 
 lastfm_source::lastfm_source()
     : music_source(S_SOURCE_LAST_FM, T_SOURCE_LASTFM, new lastfm)
@@ -47,6 +61,32 @@ void lastfm_source::load()
     } else {
         m_custom_api_key = true;
     }
+
+    /* The validators belong to the previous user or key */
+    m_etag.clear();
+    m_last_modified.clear();
+    m_last_track.clear();
+
+    /* last.fm doesn't want apps to constantly send requets
+     * to their API points
+     * so this source uses slower refresh than the user might configure
+     * in the gui if the shared api key is used.
+     * Since we don't know the progress of the song there's no way to
+     * determine when the next request would be due, so a query every
+     * five seconds should be slow enough, unless a custom api key is
+     * used.
+     */
+    if (m_custom_api_key)
+        rate_limiter::configure(LASTFM_HOST, 1, 2);
+    else
+        rate_limiter::configure(LASTFM_HOST, 0.2, 1);
+}
+
+/* Same interval as the rate limit above */
+refresh_cadence lastfm_source::cadence() const
+{
+    uint32_t interval = m_custom_api_key ? 1000 : 5000;
+    return { interval, interval, false };
 }
 
 void lastfm_source::refresh()
@@ -59,40 +99,41 @@ void lastfm_source::refresh()
     if (m_username.isEmpty())
         return;
 
-    /* last.fm doesn't want apps to constantly send requets
-     * to their API points
-     * so this source uses slower refresh than the user might configure
-     * in the gui if the shared api key is used
-     */
-    if (!m_custom_api_key && os_gettime_ns() < m_next_refresh)
-        return;
+    QString track_request = "https://" LASTFM_HOST "/2.0/?method=user.getrecenttracks&user=" + m_username + "&api_key=" + m_api_key + "&limit=1&format=json";
 
+    /* Song info is kept until a response tells us that the track changed */
     begin_refresh();
-    m_current.clear();
-    QString track_request = "https://ws.audioscrobbler.com/2.0/?method=user.getrecenttracks&user=" + m_username + "&api_key=" + m_api_key + "&limit=1&format=json";
+    if (!rate_limiter::acquire(track_request))
+        return;
+
     QJsonDocument response;
-    auto code = lastfm_request(response, track_request);
+    std::string header;
+    auto code = lastfm_request(response, track_request, header, m_etag, m_last_modified);
+    if (code == HTTP_NOT_MODIFIED)
+        return;
+
     if (code == HTTP_OK) {
-        auto recent_tracks = response.object()["recenttracks"].toObject();
+        m_etag = util::get_header_value(header, "ETag");
+        m_last_modified = util::get_header_value(header, "Last-Modified");
 
+        QJsonObject song;
+        auto recent_tracks = response.object()["recenttracks"].toObject();
         if (recent_tracks["track"].isArray()) {
             auto track_arr = recent_tracks["track"].toArray();
-            if (track_arr.size() > 0) {
-                auto song = track_arr[0].toObject();
-                if (!song.isEmpty())
-                    parse_song(song);
-            }
+            if (track_arr.size() > 0)
+                song = track_arr[0].toObject();
         }
 
-        /* Since we don't know the progress of the song there's no way to
-         * determine when the next request would be due, so a query every
-         * five seconds should be slow enough, unless a custom api key is
-         * used.
-         */
-        m_next_refresh = os_gettime_ns() + 5000000000;
+        auto id = song.isEmpty() ? QString() : track_identity(song);
+        if (id == m_last_track && !id.isEmpty())
+            return;
+
+        m_last_track = id;
+        m_current.clear();
+        if (!song.isEmpty())
+            parse_song(song);
     } else {
         berr("Received error code from last.fm request: %i", int(code));
-        m_next_refresh = os_gettime_ns() + 1500000000;
     }
 }
 
@@ -112,7 +153,6 @@ void lastfm_source::parse_song(const QJsonObject& s)
                 m_current.set(meta::COVER, cover.toObject()["#text"].toString());
         }
     }
-    util::download_cover(m_current.get(meta::COVER));
 
     if (s["artist"].isObject())
         m_current.set(meta::ARTIST, QStringList(s["artist"].toObject()["#text"].toString()));
@@ -136,15 +176,26 @@ bool lastfm_source::enabled() const
 
 /* === cURL stuff == */
 
-long lastfm_request(QJsonDocument& response_json, const QString& url)
+long lastfm_request(QJsonDocument& response_json, const QString& url, std::string& header, const std::string& etag, const std::string& last_modified)
 {
     CURL* curl = curl_easy_init();
     std::string response;
     long http_code = -1;
+    struct curl_slist* list = nullptr;
+
+    /* Only sent if a previous response had these validators */
+    if (!etag.empty())
+        list = curl_slist_append(list, ("If-None-Match: " + etag).c_str());
+    if (!last_modified.empty())
+        list = curl_slist_append(list, ("If-Modified-Since: " + last_modified).c_str());
+    if (list)
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, list);
     // curl_easy_setopt(curl, CURLOPT_POST, 1L);
     curl_easy_setopt(curl, CURLOPT_URL, qt_to_utf8(url));
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, util::write_callback);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, util::write_callback);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &header);
 #ifdef DEBUG
     curl_easy_setopt(curl, CURLOPT_VERBOSE, 1);
 #endif
@@ -152,14 +203,18 @@ long lastfm_request(QJsonDocument& response_json, const QString& url)
 
     if (res == CURLE_OK) {
         curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
-        QJsonParseError err;
-        response_json = QJsonDocument::fromJson(response.c_str(), &err);
-        if (response_json.isNull() && !response.empty())
-            berr("Failed to parse json response: %s, Error: %s", response.c_str(), qt_to_utf8(err.errorString()));
+        if (http_code != HTTP_NOT_MODIFIED) {
+            QJsonParseError err;
+            response_json = QJsonDocument::fromJson(response.c_str(), &err);
+            if (response_json.isNull() && !response.empty())
+                berr("Failed to parse json response: %s, Error: %s", response.c_str(), qt_to_utf8(err.errorString()));
+        }
     } else {
-        berr("CURL failed while sending spotify command");
+        berr("CURL failed while sending last.fm request");
     }
 
+    rate_limiter::report(url, http_code, header);
+    curl_slist_free_all(list);
     curl_easy_cleanup(curl);
     return http_code;
 }
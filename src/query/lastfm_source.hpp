@@ -19,11 +19,17 @@
 #pragma once
 #include "../util/constants.hpp"
 #include "music_source.hpp"
+#include <string>
 
 class lastfm_source : public music_source {
     QString m_username, m_api_key;
     bool m_custom_api_key = false;
-    uint64_t m_next_refresh = 0;
+
+    /* Identity of the last parsed track and the validators of the last
+     * response, used to skip work if nothing changed since the last poll */
+    QString m_last_track;
+    std::string m_etag, m_last_modified;
+
     void parse_song(const QJsonObject& s);
 
 public:
@@ -31,6 +37,7 @@ public:
 
     void load() override;
     void refresh() override;
+    refresh_cadence cadence() const override;
     bool execute_capability(capability c) override;
     bool enabled() const override;
 };
@@ -23,6 +23,7 @@
 #include "../util/cover_tag_handler.hpp"
 #include "../util/lyrics_handler.hpp"
 #include "../util/utility.hpp"
+#include <QFileInfo>
 #include <QStringList>
 #include <obs-module.h>
 #include <taglib/fileref.h>
@@ -31,7 +32,7 @@ mpd_source::mpd_source()
     : music_source(S_SOURCE_MPD, T_SOURCE_MPD, new mpd)
 {
     m_capabilities = CAP_NEXT_SONG | CAP_PREV_SONG | CAP_PLAY_PAUSE | CAP_STOP_SONG | CAP_VOLUME_UP | CAP_VOLUME_DOWN | CAP_VOLUME_MUTE;
-    supported_metadata({ meta::TITLE, meta::ARTIST, meta::ALBUM, meta::RELEASE, meta::RELEASE_DAY, meta::RELEASE_MONTH, meta::RELEASE_YEAR, meta::COVER, meta::LYRICS, meta::DURATION, meta::DISC_NUMBER, meta::TRACK_NUMBER, meta::PROGRESS, meta::STATUS, meta::LABEL, meta::FILE_NAME });
+    supported_metadata({ meta::TITLE, meta::ARTIST, meta::ALBUM, meta::RELEASE, meta::RELEASE_DAY, meta::RELEASE_MONTH, meta::RELEASE_YEAR, meta::COVER, meta::LYRICS, meta::DURATION, meta::DISC_NUMBER, meta::TRACK_NUMBER, meta::PROGRESS, meta::STATUS, meta::LABEL, meta::FILE_NAME, meta::ALBUM_ARTIST, meta::GENRE, meta::TRACK_TOTAL, meta::DISC_TOTAL });
     m_address = nullptr;
     m_port = 0;
 }
@@ -84,11 +85,13 @@ void mpd_source::load()
     CDEF_STR(CFG_MPD_IP, "localhost");
     CDEF_BOOL(CFG_MPD_LOCAL, true);
     CDEF_STR(CFG_MPD_BASE_FOLDER, "");
+    CDEF_STR(CFG_MPD_COVER_NAMES, "cover.*;folder.*;front.*;album.*;*cover*");
 
     m_address = utf8_to_qt(CGET_STR(CFG_MPD_IP));
     m_base_folder = utf8_to_qt(CGET_STR(CFG_MPD_BASE_FOLDER));
     m_port = CGET_UINT(CFG_MPD_PORT);
     m_local = CGET_BOOL(CFG_MPD_LOCAL);
+    cover::set_local_cover_names(utf8_to_qt(CGET_STR(CFG_MPD_COVER_NAMES)));
 }
 
 static inline play_state from_mpd_state(mpd_state s)
@@ -196,18 +199,28 @@ void mpd_source::refresh()
         file_path.prepend(m_base_folder);
         m_song_file_path = file_path;
 
+        /* The file is only parsed if these tags aren't cached for this
+         * version of it. The same pass also gets the lyrics and, if it's
+         * going to be needed, the cover for handle_cover */
+        song_file().fill(m_current, album_key());
+
         /* The song url link is now used by the browser widget which requires
          * a proper url to embed it into the browser source, the actal
          * retrieval of the cover is done via m_song_file_path which checks
          * the song file for cover tags as well as the folder the file is in
          */
-        QString path = config::cover_path;
+        if (config::write_cover) {
+            QString path = config::cover_path;
 
-        // Convert to proper file:// url
-        path = '/' + path;
-        path.replace('\\', '/'); // url has to use unix separators
-        path = "file://" + path;
-        m_current.set(meta::COVER, path);
+            // Convert to proper file:// url
+            path = '/' + path;
+            path.replace('\\', '/'); // url has to use unix separators
+            path = "file://" + path;
+            m_current.set(meta::COVER, path);
+        } else if (config::webserver_enabled) {
+            /* The cover file isn't written, but the web server has it */
+            m_current.set(meta::COVER, QString("http://localhost:%1/cover.png").arg(config::webserver_port));
+        }
     }
 
     if (mpd_song)
@@ -216,15 +229,33 @@ void mpd_source::refresh()
         mpd_status_free(status);
 }
 
+/* Files of the same album in the same folder share their cover */
+QString mpd_source::album_key() const
+{
+    if (!m_current.has(meta::ALBUM))
+        return {};
+    return QFileInfo(m_song_file_path).path() + '/' + m_current.get<QString>(meta::ALBUM);
+}
+
+tag_file& mpd_source::song_file()
+{
+    if (!m_song_file || m_song_file->path() != m_song_file_path)
+        m_song_file = std::make_unique<tag_file>(m_song_file_path);
+    return *m_song_file;
+}
+
 void mpd_source::handle_cover()
 {
     if (m_current == m_prev)
         return;
 
     if (m_current.get<int>(meta::STATUS) == state_playing) {
+        if (m_current.identity() == m_cover_identity)
+            return;
+
         bool result = false;
         QString file_path = m_song_file_path, tmp;
-        if (cover::find_embedded_cover(file_path)) {
+        if (cover::find_embedded_cover(song_file(), album_key())) {
             result = true;
         } else {
             cover::get_file_folder(file_path);
@@ -235,8 +266,12 @@ void mpd_source::handle_cover()
                 result = util::download_cover(tmp);
             }
         }
-        if (!result && !download_missing_cover())
+        if (result || download_missing_cover()) {
+            m_cover_identity = m_current.identity();
+        } else {
             util::reset_cover();
+            m_cover_identity = 0;
+        }
     } else if (m_current.get<int>(meta::STATUS) != state_paused || config::placeholder_when_paused) {
         /* We either
             - are in a stopped/unknown state                -> reset cover
@@ -247,24 +282,23 @@ void mpd_source::handle_cover()
             download_missing_cover();
         else
             util::reset_cover();
+        m_cover_identity = 0;
     }
 }
 
 void mpd_source::handle_lyrics()
 {
-    if (m_current == m_prev)
+    if (m_current == m_prev && !lyrics::retry_due(m_current))
         return;
 
     if (m_current.get<int>(meta::STATUS) == state_playing) {
-        bool result = false;
+        /* A separate .lrc file is usually synced, so it's preferred */
         QString file_path = m_song_file_path;
-        if (lyrics::find_embedded_lyrics(file_path)) {
-            result = true;
-        }
+        bool result = lyrics::find_local_lyrics(file_path) || lyrics::find_embedded_lyrics(song_file());
         if (!result && !lyrics::download_missing_lyrics(m_current))
-            util::reset_lyrics();
+            lyrics::clear();
     } else {
-        util::reset_lyrics();
+        lyrics::clear();
     }
 }
 
@@ -18,8 +18,10 @@
 
 #pragma once
 #include "../util/constants.hpp"
+#include "../util/tag_file.hpp"
 #include "music_source.hpp"
 
+#include <memory>
 #include <mpd/client.h>
 
 class mpd_source : public music_source {
@@ -27,6 +29,7 @@ class mpd_source : public music_source {
     QString m_address;
     QString m_base_folder;
     QString m_song_file_path;
+    std::unique_ptr<tag_file> m_song_file; /* tags of the current song file */
     uint16_t m_port;
     bool m_local;
     mpd_connection* m_connection {};
@@ -38,6 +41,8 @@ public:
 
     void load() override;
     void refresh() override;
+    /* Local player, the connection is cheap */
+    refresh_cadence cadence() const override { return { 200, 100, false }; }
     bool execute_capability(capability c) override;
     bool enabled() const override;
     void handle_cover() override;
@@ -46,6 +51,8 @@ public:
 
 private:
     void ensure_connection();
+    tag_file& song_file();
+    QString album_key() const;
 
     void close_connection()
     {
@@ -20,6 +20,7 @@
 #include "../gui/widgets/mpris.hpp"
 #include "../util/config.hpp"
 #include "../util/constants.hpp"
+#include "../util/tuna_thread.hpp"
 #include "../util/utility.hpp"
 
 /**
@@ -461,6 +462,7 @@ DBusHandlerResult mpris_source::handle_mpris(DBusMessage* message)
         }
         m_info[player].metadata.set(meta::TRACK_NUMBER, 0); // borked on vlc
     }
+    tuna_thread::wake(this);
     return DBUS_HANDLER_RESULT_HANDLED;
 }
 
@@ -481,6 +483,12 @@ mpris_source::mpris_source()
     }
 }
 
+/* Changes are pushed, but the position isn't */
+refresh_cadence mpris_source::cadence() const
+{
+    return { config::refresh_rate, 50, true };
+}
+
 mpris_source::~mpris_source()
 {
     m_thread_flag = false;
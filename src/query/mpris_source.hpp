@@ -64,6 +64,8 @@ public:
 
     void load() override;
     void refresh() override;
+    /* Changes are received over D-Bus, refreshes only pick up the progress */
+    refresh_cadence cadence() const override;
     void internal_refresh();
     bool execute_capability(capability) override { return false; }
     bool enabled() const override { return true; }
@@ -20,8 +20,11 @@
 #include "../gui/music_control.hpp"
 #include "../gui/tuna_gui.hpp"
 #include "../util/config.hpp"
+#include "../util/lyrics_handler.hpp"
+#include "../util/rate_limiter.hpp"
 #include "../util/tuna_thread.hpp"
 #include "../util/utility.hpp"
+#include "auto_source.hpp"
 #include "gpmdp_source.hpp"
 #include "icecast_source.hpp"
 #include "lastfm_source.hpp"
@@ -52,6 +55,10 @@ QList<std::shared_ptr<music_source>> instances;
 void init()
 {
     obs_frontend_push_ui_translation(obs_module_get_string);
+    /* The iTunes search API allows roughly 20 requests per minute */
+    rate_limiter::configure("itunes.apple.com", 1 / 3., 3);
+
+    instances.append(std::make_shared<auto_source>());
     instances.append(std::make_shared<spotify_source>());
     instances.append(std::make_shared<mpd_source>());
     instances.append(std::make_shared<vlc_obs_source>());
@@ -209,6 +216,11 @@ music_source::music_source(const char* id, const char* name, source_widget* w)
 {
 }
 
+refresh_cadence music_source::cadence() const
+{
+    return { config::refresh_rate, 100, false };
+}
+
 void music_source::load()
 {
     if (m_settings_tab)
@@ -233,9 +245,13 @@ void music_source::handle_cover()
         return;
 
     if (m_current.get<int>(meta::STATUS) == state_playing) {
-        if (!util::download_cover(m_current.get(meta::COVER))) {
-            if (!download_missing_cover())
-                util::reset_cover();
+        if (m_current.identity() == m_cover_identity)
+            return;
+        if (util::download_cover(m_current.get(meta::COVER)) || download_missing_cover()) {
+            m_cover_identity = m_current.identity();
+        } else {
+            util::reset_cover();
+            m_cover_identity = 0;
         }
     } else if (m_current.get<int>(meta::STATUS) != state_paused || config::placeholder_when_paused) {
         /* We either
@@ -247,9 +263,23 @@ void music_source::handle_cover()
             download_missing_cover();
         else
             util::reset_cover();
+        m_cover_identity = 0;
     }
 }
 
+void music_source::handle_lyrics()
+{
+    if (m_current == m_prev && !lyrics::retry_due(m_current))
+        return;
+
+    /* Keep the lyrics while paused, the provider is only asked once per song */
+    auto status = m_current.get<int>(meta::STATUS);
+    if (status == state_paused)
+        return;
+    if (status != state_playing || !lyrics::download_missing_lyrics(m_current))
+        lyrics::clear();
+}
+
 void music_source::post_refresh()
 {
     if (m_prev == m_current) {
@@ -261,4 +291,8 @@ void music_source::post_refresh()
         m_current.set(meta::PLAYBACK_DATE, QDate::currentDate().toString("yyyy.MM.dd"));
         m_current.set(meta::PLAYBACK_TIME, QTime::currentTime().toString("HH:mm:ss"));
     }
+
+    /* Computed once here, every copy of the song shares the result */
+    m_current.derived();
+    publish();
 }
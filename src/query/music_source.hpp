@@ -23,6 +23,7 @@
 #include <QObject>
 #include <cstdint>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 #include "../gui/tuna_gui.hpp"
@@ -41,18 +42,41 @@ enum capability : uint32_t {
 
 /* clang-format on */
 
+/* How often a source wants to be refreshed by the query thread */
+struct refresh_cadence {
+    uint32_t preferred; /* ms */
+    uint32_t minimum;   /* ms, also applies to early refreshes of push sources */
+    bool push;          /* Source calls tuna_thread::wake() once it has new data */
+};
+
 class music_source : public QObject {
     Q_OBJECT
     const char *m_id, *m_name;
 
+    /* Copy of m_current for other threads, m_current itself is only used by
+     * the thread that refreshes the source */
+    mutable std::mutex m_info_mutex;
+    song m_info = {};
+
 protected:
     std::array<bool, meta::COUNT> m_supported_metadata {};
     uint32_t m_capabilities = 0x0;
     song m_current = {}, m_prev = {};
     source_widget* m_settings_tab = nullptr;
 
+    /* Identity of the song that the current cover belongs to, so that
+     * resuming playback doesn't download the same cover again */
+    uint64_t m_cover_identity = 0;
+
     void begin_refresh() { m_prev = m_current; }
 
+    /* Makes the refreshed song visible to song_info() */
+    void publish()
+    {
+        std::lock_guard<std::mutex> lock(m_info_mutex);
+        m_info = m_current;
+    }
+
     bool download_missing_cover();
 
     void supported_metadata(std::vector<meta::type> data)
@@ -77,15 +101,33 @@ public:
 
     bool has_capability(capability c) const { return m_capabilities & ((uint16_t)c); }
 
-    const song& song_info() const { return m_current; }
+    song song_info() const
+    {
+        std::lock_guard<std::mutex> lock(m_info_mutex);
+        return m_info;
+    }
     virtual void reset_info()
     {
         m_current.clear();
         m_prev.clear();
+        m_cover_identity = 0;
+        publish();
     }
     const char* name() const { return m_name; }
     const char* id() const { return m_id; }
 
+    /* Source that the song information currently comes from, only differs
+     * for the auto source */
+    virtual music_source* active() { return this; }
+
+    /* Makes the next cover and lyrics update treat the song as new, e.g.
+     * because it was taken over from another source */
+    void invalidate()
+    {
+        m_prev.clear();
+        m_cover_identity = 0;
+    }
+
     /* Abstract stuff */
     virtual bool enabled() const = 0;
     /* Save/load config values */
@@ -93,13 +135,19 @@ public:
     virtual void save();
     /* Perform information query */
     virtual void refresh() = 0;
+    /* Sources without their own cadence use the configured refresh rate */
+    virtual refresh_cadence cadence() const;
+    /* Sources that the query thread has to refresh for this one, the auto
+     * source only combines the information of its sources */
+    virtual std::vector<music_source*> polled_sources() { return { this }; }
+    /* Refreshed even if it isn't selected, e.g. because an output refers
+     * to it */
+    virtual bool needs_refresh() { return false; }
     /* Execute and return true if successful */
     virtual bool execute_capability(capability c) = 0;
     virtual void set_gui_values();
     virtual void handle_cover();
-    virtual void handle_lyrics()
-    { /* NO-OP */
-    }
+    virtual void handle_lyrics();
 
     source_widget* get_settings_tab() { return m_settings_tab; }
 
@@ -18,6 +18,7 @@
 
 #include "song.hpp"
 #include "../util/config.hpp"
+#include "../util/cover_pipeline.hpp"
 #include "../util/format.hpp"
 #include "music_source.hpp"
 #include <QJsonDocument>
@@ -30,9 +31,137 @@ song::song()
     clear();
 }
 
+/* Fields that make up the identity of a track */
+static const meta::type identity_fields[] = { meta::TITLE, meta::ARTIST, meta::ALBUM, meta::RELEASE, meta::COVER,
+    meta::LABEL, meta::DURATION, meta::DISC_NUMBER, meta::TRACK_NUMBER };
+
+/* Fields that the derived strings are made of */
+static const meta::type derived_fields[] = { meta::TITLE, meta::ARTIST, meta::RELEASE_DAY, meta::RELEASE_MONTH,
+    meta::RELEASE_YEAR, meta::DURATION };
+
+static inline bool is_identity_field(meta::type id)
+{
+    for (auto field : identity_fields) {
+        if (field == id)
+            return true;
+    }
+    return false;
+}
+
+/* FNV-1a */
+static const uint64_t fnv_offset = 14695981039346656037ull;
+static const uint64_t fnv_prime = 1099511628211ull;
+
+static inline void fnv_hash(uint64_t& h, const void* data, size_t size)
+{
+    auto bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) {
+        h ^= bytes[i];
+        h *= fnv_prime;
+    }
+}
+
+static inline void fnv_hash(uint64_t& h, const QString& str)
+{
+    fnv_hash(h, str.constData(), size_t(str.size()) * sizeof(QChar));
+}
+
+template<size_t N>
+static uint64_t hash_fields(QJsonObject const& data, const meta::type (&fields)[N])
+{
+    uint64_t h = fnv_offset;
+    for (auto field : fields) {
+        auto const& value = data[meta::ids[field]];
+        auto present = !value.isUndefined() && !value.isNull();
+
+        /* The field id separates the values, so that e.g. a title
+         * can't be mistaken for an album with the same name */
+        uint8_t tag = present ? field : 0xff - field;
+        fnv_hash(h, &tag, sizeof(tag));
+        if (!present)
+            continue;
+
+        if (value.isArray()) {
+            static const uint8_t separator = 0x1f;
+            for (auto const& v : value.toArray()) {
+                fnv_hash(h, v.toString());
+                fnv_hash(h, &separator, sizeof(separator));
+            }
+        } else if (value.isString()) {
+            fnv_hash(h, value.toString());
+        } else {
+            int32_t i = value.toInt();
+            fnv_hash(h, &i, sizeof(i));
+        }
+    }
+    return h;
+}
+
+void song::store(meta::type id, QJsonValue const& v)
+{
+    auto key = meta::ids[id];
+    if (m_data.value(key) == v)
+        return;
+    m_data[key] = v;
+    if (is_identity_field(id))
+        m_identity_dirty = true;
+}
+
+uint64_t song::identity() const
+{
+    if (!m_identity_dirty)
+        return m_identity;
+
+    m_identity = hash_fields(m_data, identity_fields);
+    m_identity_dirty = false;
+    return m_identity;
+}
+
+std::shared_ptr<const song_derived> song::derived() const
+{
+    /* Sources clear and set their song on every refresh, so the cache is
+     * keyed by the content of the fields and not by when they were set */
+    auto key = hash_fields(m_data, derived_fields);
+    auto cached = std::atomic_load(&m_derived);
+    if (cached && cached->key == key && cached->extensions_removed == config::remove_file_extensions)
+        return cached;
+
+    auto d = std::make_shared<song_derived>();
+    d->key = key;
+    d->extensions_removed = config::remove_file_extensions;
+
+    d->title = get(meta::TITLE);
+    if (d->extensions_removed)
+        d->title = util::remove_extensions(d->title);
+
+    auto artists = get<QStringList>(meta::ARTIST);
+    d->artists = artists.join(", ");
+    if (!artists.isEmpty())
+        d->first_artist = artists[0];
+
+    auto day = has(meta::RELEASE_DAY);
+    auto month = has(meta::RELEASE_MONTH);
+    auto year = has(meta::RELEASE_YEAR);
+    if (day && month && year) {
+        QDate date(get<int>(meta::RELEASE_YEAR), get<int>(meta::RELEASE_MONTH), get<int>(meta::RELEASE_DAY));
+        d->release_date = QLocale::system().toString(date, QLocale::ShortFormat);
+    } else if (month && year) {
+        d->release_date = QString("%1.%2").arg(get<int>(meta::RELEASE_YEAR)).arg(get<int>(meta::RELEASE_MONTH));
+    } else if (year) {
+        d->release_date = QString::number(get<int>(meta::RELEASE_YEAR));
+    }
+
+    d->duration = format::time_format(get<int>(meta::DURATION));
+
+    std::shared_ptr<const song_derived> result = d;
+    std::atomic_store(&m_derived, result);
+    return result;
+}
+
 void song::clear()
 {
     m_data = QJsonObject();
+    m_identity_dirty = true;
     set(meta::COVER, QString("n/a"));
     set(meta::LYRICS, QString("n/a"));
     set(meta::STATUS, state_unknown);
@@ -75,13 +204,7 @@ bool song::operator==(const song& other) const
     /* basically compare all data that shouldn't change in between
      * updates, unless the song changes
      */
-    /* clang-format off */
-    return get<int>(meta::STATUS) == other.get<int>(meta::STATUS) &&
-            get(meta::COVER) == other.get(meta::COVER) && get(meta::LABEL) == other.get(meta::LABEL) &&
-           get<int>(meta::DISC_NUMBER) == other.get<int>(meta::DISC_NUMBER) && get<int>(meta::TRACK_NUMBER) == other.get<int>(meta::TRACK_NUMBER) &&
-           get<int>(meta::DURATION) == other.get<int>(meta::DURATION) && get(meta::TITLE) == other.get(meta::TITLE) && get(meta::ALBUM) == get(meta::ALBUM) &&
-           get(meta::RELEASE) == other.get(meta::RELEASE);
-    /* clang-format on */
+    return identity() == other.identity() && get<int>(meta::STATUS) == other.get<int>(meta::STATUS);
 }
 
 bool song::operator!=(const song& other) const
@@ -110,12 +233,21 @@ void song::to_json(QJsonObject& obj) const
     }
     obj["status"] = status;
 
-    if (config::remove_file_extensions)
-        obj["title"] = util::remove_extensions(obj["title"].toString());
+    if (config::remove_file_extensions && has(meta::TITLE))
+        obj["title"] = derived()->title;
 
     if (has(meta::COVER)) {
         // Just points to the /cover.png end point
         obj["cover_url"] = QString("http://localhost:%1/cover.png").arg(QString::number(config::webserver_port));
+
+        auto colors = cover_pipeline::current_palette();
+        if (colors.valid()) {
+            QJsonObject palette;
+            palette["dominant"] = colors.dominant.name();
+            palette["vibrant"] = colors.vibrant.name();
+            palette["muted"] = colors.muted.name();
+            obj["cover_colors"] = palette;
+        }
     }
 
     // Technically deprecated, because the json object
@@ -155,6 +287,7 @@ void song::from_json(const QJsonObject& obj)
      * so we only parse supported options */
     clear();
     m_data = obj;
+    m_identity_dirty = true;
 
     // TODO: Use only one of the three cover_path/cover_url/cover
     // currently sources use cover_path, the web browser widget uses cover_url
@@ -24,6 +24,7 @@
 #include <QString>
 #include <QVariant>
 #include <array>
+#include <memory>
 #include <stdint.h>
 
 class QJsonObject;
@@ -153,9 +154,31 @@ enum type : uint8_t {
 static_assert(sizeof(ids) / sizeof(char*) - 1 == COUNT, "");
 }
 
+/* Display strings derived from the song data. They're computed once per
+ * version of the fields they depend on and shared between all copies of the
+ * song, so outputs, the web server and the dock don't format them again.
+ * Progress changes every refresh, so it isn't part of them */
+struct song_derived {
+    uint64_t key;
+    bool extensions_removed;
+    QString title;
+    QString artists;
+    QString first_artist;
+    QString release_date;
+    QString duration;
+};
+
 class song {
     date_precision m_release_precision;
     QJsonObject m_data;
+    /* Songs are read by several threads, so this is only accessed with
+     * std::atomic_load/std::atomic_store */
+    mutable std::shared_ptr<const song_derived> m_derived;
+    mutable uint64_t m_identity = 0;
+    mutable bool m_identity_dirty = true;
+
+    /* Only marks the song as changed if the value differs */
+    void store(meta::type id, QJsonValue const& v);
 
 public:
     song();
@@ -167,7 +190,7 @@ public:
     template<meta::type T>
     void reset()
     {
-        m_data[meta::ids[T]] = QJsonValue();
+        store(T, QJsonValue());
     }
 
     bool has(meta::type id) const
@@ -185,6 +208,14 @@ public:
     bool is(meta::type id) const;
 
     QJsonObject const& data() const { return m_data; }
+    /* Computes the derived strings if the fields they depend on changed since
+     * the last call */
+    std::shared_ptr<const song_derived> derived() const;
+
+    /* 64-bit fingerprint of the fields that only change when the track
+     * changes (title, artists, album, cover etc.), progress and status
+     * aren't part of it. Only recomputed after one of these fields was set */
+    uint64_t identity() const;
     date_precision release_precision() const { return m_release_precision; }
 
     bool operator==(const song& other) const;
@@ -267,25 +298,25 @@ inline void song::set(meta::type id, QString const& v)
 {
     // This _needs_ to be a qstringlist
     Q_ASSERT(id != meta::ARTIST);
-    m_data[meta::ids[id]] = v;
+    store(id, v);
 }
 
 template<>
 inline void song::set(meta::type id, play_state const& v)
 {
-    m_data[meta::ids[id]] = (int)v;
+    store(id, int(v));
 }
 
 template<>
 inline void song::set(meta::type id, int const& v)
 {
-    m_data[meta::ids[id]] = v;
+    store(id, v);
 }
 
 template<>
 inline void song::set(meta::type id, bool const& v)
 {
-    m_data[meta::ids[id]] = v;
+    store(id, v);
 }
 
 template<>
@@ -294,5 +325,5 @@ inline void song::set(meta::type id, QStringList const& v)
     QJsonArray a;
     for (auto const& l : v)
         a.append(l);
-    m_data[meta::ids[id]] = a;
+    store(id, a);
 }
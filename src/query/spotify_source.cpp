@@ -22,6 +22,7 @@
 #include "../gui/widgets/spotify.hpp"
 #include "../util/config.hpp"
 #include "../util/constants.hpp"
+#include "../util/rate_limiter.hpp"
 #if !defined(SPOTIFY_CREDENTIALS)
 #    include "../util/creds.hpp"
 #endif
@@ -30,6 +31,7 @@
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QString>
+#include <algorithm>
 #include <curl/curl.h>
 #include <util/config-file.h>
 #include <util/platform.h>
@@ -42,12 +44,17 @@
 #define PLAYER_PREVIOUS_URL (PLAYER_URL "/previous")
 #define PLAYER_VOLUME_URL (PLAYER_URL "/volume")
 #define CURL_DEBUG 0L
+#define API_HOST "api.spotify.com"
 #define REDIRECT_URI "https%3A%2F%2Funivrsal.github.io%2Fauth%2Ftoken"
 
 spotify_source::spotify_source()
     : music_source(S_SOURCE_SPOTIFY, T_SOURCE_SPOTIFY, new spotify)
 {
     build_credentials();
+    /* Spotify uses a rolling 30 second window for their rate limit, this
+     * leaves enough room for the player endpoint, playlist lookups and
+     * commands sent from the dock */
+    rate_limiter::configure(API_HOST, 3, 6);
     m_capabilities = CAP_NEXT_SONG | CAP_PREV_SONG | CAP_PLAY_PAUSE | CAP_VOLUME_MUTE | CAP_PREV_SONG;
     supported_metadata({ meta::TITLE, meta::ARTIST, meta::ALBUM, meta::RELEASE, meta::COVER, meta::DURATION, meta::PROGRESS, meta::STATUS, meta::URL, meta::CONTEXT_URL, meta::PLAYLIST_NAME });
 }
@@ -110,20 +117,10 @@ void spotify_source::load()
 long execute_command(const char* auth_token, const char* url, std::string& response_header,
     QJsonDocument& response_json, int64_t curl_timeout, const char* custom_request_type = nullptr, const char* request_data = nullptr);
 
-void extract_timeout(const std::string& header, uint64_t& timeout)
+/* The Web API is rate limited per app, so this doesn't go below a second */
+refresh_cadence spotify_source::cadence() const
 {
-    static const std::string what = "Retry-After: ";
-    timeout = 0;
-    auto pos = header.find(what);
-
-    if (pos != std::string::npos) {
-        pos += what.length();
-        auto end = pos;
-        while (header.at(end) != '\n')
-            end++;
-        const auto tmp = header.substr(pos, end - pos);
-        timeout = std::stoi(tmp);
-    }
+    return { std::max<uint32_t>(config::refresh_rate, 1000), 1000, false };
 }
 
 void spotify_source::refresh()
@@ -142,15 +139,9 @@ void spotify_source::refresh()
         save();
     }
 
-    if (m_timout_start) {
-        if (os_gettime_ns() - m_timout_start >= m_timeout_length) {
-            m_timout_start = 0;
-            m_timeout_length = 0;
-            binfo("API timeout of %i seconds is over", int(m_timeout_length));
-        } else {
-            bdebug("Waiting for Spotify-API timeout");
-            return;
-        }
+    if (rate_limiter::wait_time_ms(PLAYER_URL) > 0) {
+        bdebug("Waiting for Spotify-API timeout");
+        return;
     }
 
     std::string header = "";
@@ -190,20 +181,10 @@ void spotify_source::refresh()
     } else if (http_code == HTTP_NO_CONTENT) {
         /* No session running */
         m_current.clear();
-    } else {
-        /* Don't reset cover or info here since
-         * we're just waiting for the API to give a proper
-         * response again
-         */
-        if (http_code == STATUS_RETRY_AFTER && !header.empty()) {
-            extract_timeout(header, m_timeout_length);
-            if (m_timeout_length) {
-                bwarn("Spotify-API Rate limit hit, waiting %i seconds\n", int(m_timeout_length));
-                m_timeout_length *= SECOND_TO_NS;
-                m_timout_start = os_gettime_ns();
-            }
-        }
     }
+    /* Otherwise don't reset cover or info since we're just waiting for
+     * the API to give a proper response again, any Retry-After is handled
+     * by the rate limiter */
     bdebug("[Spotify] Finished refresh");
 }
 
@@ -289,7 +270,7 @@ void spotify_source::parse_track_json(const QJsonValue& response)
 bool spotify_source::execute_capability(capability c)
 {
     QString const token = qt_to_utf8(m_token);
-    auto const playing = m_current.get<int>(meta::STATUS);
+    auto const playing = song_info().get<int>(meta::STATUS);
     auto timeout = m_curl_timeout_ms;
     // offload this into a separate thread because the request
     // can take up to one second
@@ -381,6 +362,11 @@ void request_token(const std::string& request, const std::string& credentials, Q
         return;
     }
 
+    if (!rate_limiter::acquire(TOKEN_URL)) {
+        berr("Waiting for Spotify-API timeout before requesting a token");
+        return;
+    }
+
     std::string response, response_header;
     std::string header = "Authorization: Basic ";
     header.append(credentials);
@@ -388,8 +374,10 @@ void request_token(const std::string& request, const std::string& credentials, Q
     auto* list = curl_slist_append(nullptr, header.c_str());
     CURL* curl = prepare_curl(list, &response, &response_header, request, timeout);
     CURLcode res = curl_easy_perform(curl);
+    long http_code = -1;
 
     if (res == CURLE_OK) {
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
         QJsonParseError err;
         response_json = QJsonDocument::fromJson(response.c_str(), &err);
         if (response_json.isNull()) {
@@ -409,6 +397,7 @@ void request_token(const std::string& request, const std::string& credentials, Q
         berr("Curl returned error code (%i) %s", res, curl_easy_strerror(res));
     }
 
+    rate_limiter::report(TOKEN_URL, http_code, response_header);
     curl_slist_free_all(list);
     curl_easy_cleanup(curl);
 }
@@ -509,18 +498,8 @@ bool spotify_source::new_token(QString& log)
 long execute_command(const char* auth_token, const char* url, std::string& response_header,
     QJsonDocument& response_json, int64_t curl_timeout, const char* custom_request_type, const char* request_data)
 {
-    static int timeout_start = 0;
-    static int timeout = 0;
-    static int timeout_multiplier = 1;
-
-    if (timeout > 0) {
-        if (util::epoch() - timeout_start >= timeout) {
-            binfo("cURL request timeout over.");
-            timeout = 0;
-        } else {
-            return 0; // Waiting for timeout to be over
-        }
-    }
+    if (!rate_limiter::acquire(url))
+        return 0; // Waiting for timeout to be over
 
     long http_code = -1;
     std::string response;
@@ -560,21 +539,14 @@ long execute_command(const char* auth_token, const char* url, std::string& respo
         QJsonParseError err;
 
         response_json = QJsonDocument::fromJson(response.c_str(), &err);
-        if (response_json.isNull() && !response.empty()) {
+        if (response_json.isNull() && !response.empty())
             berr("Failed to parse json response: %s, Error: %s", response.c_str(), qt_to_utf8(err.errorString()));
-        } else {
-            timeout_multiplier = 1; // Reset on successful requests
-            timeout_start = 0;
-            timeout = 0;
-        }
     } else {
-        timeout_start = util::epoch();
-        timeout = 5 * timeout_multiplier++;
-        berr(
-            "cURL failed while sending spotify command (HTTP error %i, cURL error %i: '%s'). Waiting %i seconds before trying again",
-            int(http_code), res, curl_easy_strerror(res), timeout);
+        berr("cURL failed while sending spotify command (HTTP error %i, cURL error %i: '%s')",
+            int(http_code), res, curl_easy_strerror(res));
     }
 
+    rate_limiter::report(url, http_code, response_header);
     curl_slist_free_all(list);
     curl_easy_cleanup(curl);
     return http_code;
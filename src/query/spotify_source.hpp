@@ -35,8 +35,6 @@ class spotify_source : public music_source {
 
     int64_t m_curl_timeout_ms = 1000;
 
-    uint64_t m_timeout_length = 0, /* Rate limit timeout length */
-        m_timout_start = 0;        /* Timeout start */
     void parse_track_json(const QJsonValue& track);
     void build_credentials();
 
@@ -46,6 +44,7 @@ public:
     bool enabled() const override;
     void load() override;
     void refresh() override;
+    refresh_cadence cadence() const override;
     bool execute_capability(capability c) override;
     bool do_refresh_token(QString& log);
     bool new_token(QString& log);
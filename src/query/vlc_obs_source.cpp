@@ -19,11 +19,21 @@
 #include "vlc_obs_source.hpp"
 #include "../gui/tuna_gui.hpp"
 #include "../gui/widgets/vlc.hpp"
+#include "../util/config.hpp"
 #include "../util/constants.hpp"
 #include "../util/tuna_thread.hpp"
 #include "../util/utility.hpp"
+#include <QRegularExpression>
 #include <QUrl>
 #include <obs-frontend-api.h>
+#include <vector>
+
+/* Requested names are dropped if they weren't asked for in this many
+ * refreshes, about ten seconds */
+#define REQUEST_TIMEOUT 50
+
+/* Global signals that can change which VLC source is the target */
+static const char* global_signals[] = { "source_create", "source_destroy", "source_remove", "source_rename", "source_activate", "source_deactivate" };
 
 vlc_obs_source::vlc_obs_source()
     : music_source(S_SOURCE_VLC, T_SOURCE_VLC, new vlc)
@@ -41,59 +51,128 @@ vlc_obs_source::vlc_obs_source()
             meta::EPISODE, meta::SHOW_NAME, meta::ALBUM_ARTIST,
             meta::DISC_TOTAL });
     /* clang-format on */
+
+    obs_frontend_add_event_callback(frontend_event, this);
+    auto* sh = obs_get_signal_handler();
+    for (auto const* signal : global_signals)
+        signal_handler_connect(sh, signal, sources_changed, this);
 }
 
 vlc_obs_source::~vlc_obs_source()
 {
-    m_weak_src = nullptr;
+    auto* sh = obs_get_signal_handler();
+    for (auto const* signal : global_signals)
+        signal_handler_disconnect(sh, signal, sources_changed, this);
+    obs_frontend_remove_event_callback(frontend_event, this);
+
+    std::lock_guard<std::mutex> lock(m_tracks_mutex);
+    m_tracks.clear();
 }
 
-bool vlc_obs_source::reload()
+void vlc_obs_source::frontend_event(enum obs_frontend_event event, void* data)
 {
-    auto result = !!m_weak_src;
-    auto target_source_name = get_target_source_name();
-    const auto name_changed_or_no_weak_src = !m_weak_src || m_target_source_name != target_source_name;
-
-    // Try to find the vlc source with the new name
-    if (name_changed_or_no_weak_src && !target_source_name.empty())
-        load_vlc_source();
-
-    if (m_weak_src) {
-        OBSSourceAutoRelease src = obs_weak_source_get_source(m_weak_src);
-        if (src) {
-            result = obs_source_showing(src);
-            if (!result) {
-                m_current.clear();
-                m_current.set(meta::STATUS, state_stopped);
-            }
-        } else {
-            get_ui<vlc>()->rebuild_mapping();
-            result = false;
-            m_weak_src = nullptr;
-        }
+    switch (event) {
+    case OBS_FRONTEND_EVENT_SCENE_CHANGED:
+    case OBS_FRONTEND_EVENT_SCENE_LIST_CHANGED:
+    case OBS_FRONTEND_EVENT_SCENE_COLLECTION_CHANGED:
+        static_cast<vlc_obs_source*>(data)->m_target_dirty = true;
+        break;
+    default:;
     }
+}
 
-    return result;
+/* Only VLC sources and scenes (whose names are used in the mappings) can
+ * change the target */
+void vlc_obs_source::sources_changed(void* data, calldata_t* cd)
+{
+    auto* src = static_cast<obs_source_t*>(calldata_ptr(cd, "source"));
+    if (!src)
+        return;
+    const auto* id = obs_source_get_id(src);
+    if ((id && strcmp(id, "vlc_source") == 0) || obs_source_is_scene(src))
+        static_cast<vlc_obs_source*>(data)->m_target_dirty = true;
 }
 
-void vlc_obs_source::load_vlc_source()
+/* Called from the media thread of the VLC source */
+void vlc_track::media_changed(void* data, calldata_t*)
 {
-    m_target_source_name = get_target_source_name();
+    auto* self = static_cast<vlc_track*>(data);
+    self->tags_dirty = true;
+    tuna_thread::wake(self->owner);
+}
 
-    OBSSourceAutoRelease src = obs_get_source_by_name(m_target_source_name.c_str());
-    m_weak_src = nullptr;
+static const char* media_signals[] = { "media_started", "media_next", "media_previous" };
 
+void vlc_track::attach()
+{
+    detach();
+    OBSSourceAutoRelease src = obs_get_source_by_name(name.c_str());
+    if (!src)
+        return;
+
+    const auto* id = obs_source_get_id(src);
+    if (strcmp(id, "vlc_source") != 0) {
+        binfo("%s (%s) is not a valid vlc source", name.c_str(), id);
+        return;
+    }
+
+    auto* sh = obs_source_get_signal_handler(src);
+    for (auto const* signal : media_signals)
+        signal_handler_connect(sh, signal, media_changed, this);
+    weak_src = obs_source_get_weak_source(src);
+    tags_dirty = true;
+}
+
+void vlc_track::detach()
+{
+    /* If the source is already gone its signal handler went with it */
+    OBSSourceAutoRelease src = obs_weak_source_get_source(weak_src);
     if (src) {
-        const auto* id = obs_source_get_id(src);
-        if (strcmp(id, "vlc_source") == 0) {
-            m_weak_src = obs_source_get_weak_source(src);
-        } else {
-            binfo("%s (%s) is not a valid vlc source", m_target_source_name.c_str(), id);
-        }
+        auto* sh = obs_source_get_signal_handler(src);
+        for (auto const* signal : media_signals)
+            signal_handler_disconnect(sh, signal, media_changed, this);
     }
+    weak_src = nullptr;
 }
 
-std::string vlc_obs_source::get_target_source_name()
+/* False if the source was removed or renamed */
+bool vlc_track::attached_to_name()
+{
+    OBSSourceAutoRelease src = obs_weak_source_get_source(weak_src);
+    return src && name == obs_source_get_name(src);
+}
+
+void vlc_obs_source::update_tracks()
+{
+    auto target = resolve_target_source_name();
+    std::set<std::string> names;
+    if (!target.empty())
+        names.insert(target);
+    for (auto const& mapping : static_cast<vlc*>(get_settings_tab())->get_mappings_for_scene(m_target_scene.c_str()))
+        names.insert(qt_to_utf8(mapping.toString()));
+
+    std::lock_guard<std::mutex> lock(m_tracks_mutex);
+    names.insert(m_output_names.begin(), m_output_names.end());
+    for (auto const& [name, last] : m_requested)
+        names.insert(name);
+    m_target_source_name = target;
+    for (auto it = m_tracks.begin(); it != m_tracks.end();) {
+        if (names.count(it->first) == 0)
+            it = m_tracks.erase(it);
+        else
+            ++it;
+    }
+
+    for (auto const& name : names) {
+        auto& track = m_tracks[name];
+        if (!track)
+            track = std::make_unique<vlc_track>(this, name);
+        if (!track->attached_to_name())
+            track->attach();
+    }
+}
+
+std::string vlc_obs_source::resolve_target_source_name()
 {
     auto current_scene_name = get_current_scene_name();
 
@@ -103,7 +182,6 @@ std::string vlc_obs_source::get_target_source_name()
     auto mappings = static_cast<vlc*>(get_settings_tab())->get_mappings_for_scene(current_scene_name.c_str());
 
     if (mappings.empty()) {
-        OBSSourceAutoRelease scene = obs_frontend_get_current_scene();
         // We don't have any mappings -> try to find the first active VLC source
         const char* data {};
         obs_enum_sources([](void* data, obs_source_t* src) {
@@ -123,7 +201,7 @@ std::string vlc_obs_source::get_target_source_name()
         return "";
     }
 
-    m_index = qMin(mappings.size(), m_index);
+    m_index = qMin(int(mappings.size()) - 1, m_index);
     return qt_to_utf8(mappings[m_index].toString());
 }
 
@@ -143,6 +221,7 @@ bool vlc_obs_source::enabled() const
 void vlc_obs_source::next_vlc_source()
 {
     std::lock_guard<std::mutex> lock(tuna_thread::thread_mutex);
+    m_target_dirty = true;
     auto mappings = static_cast<vlc*>(get_settings_tab())->get_mappings_for_scene(m_target_scene.c_str());
     if (mappings.empty())
         return;
@@ -152,6 +231,7 @@ void vlc_obs_source::next_vlc_source()
 void vlc_obs_source::prev_vlc_source()
 {
     std::lock_guard<std::mutex> lock(tuna_thread::thread_mutex);
+    m_target_dirty = true;
     auto mappings = static_cast<vlc*>(get_settings_tab())->get_mappings_for_scene(m_target_scene.c_str());
     if (mappings.empty())
         return;
@@ -169,9 +249,17 @@ void vlc_obs_source::set_gui_values()
 void vlc_obs_source::load()
 {
     music_source::load();
-    if (!util::have_vlc_source || m_weak_src)
-        return;
-    load_vlc_source();
+    /* The mappings or the outputs might have changed */
+    static const QRegularExpression vlc_spec(R"(\{vlc:([^:}]+):)", QRegularExpression::CaseInsensitiveOption);
+    std::lock_guard<std::mutex> lock(m_tracks_mutex);
+    m_requested.clear();
+    m_output_names.clear();
+    for (auto const& o : std::as_const(config::outputs)) {
+        auto it = vlc_spec.globalMatch(o.format);
+        while (it.hasNext())
+            m_output_names.insert(qt_to_utf8(it.next().captured(1)));
+    }
+    m_target_dirty = true;
 }
 
 static play_state from_obs_state(obs_media_state s)
@@ -194,26 +282,9 @@ static play_state from_obs_state(obs_media_state s)
     }
 }
 
-void vlc_obs_source::refresh()
+void vlc_track::read_tags(obs_source_t* src)
 {
-    begin_refresh();
-    m_current.clear();
-    if (!reload())
-        return;
-
-    /* we keep a reference here to make sure that this source won't be freed
-     * while we still need it */
-    OBSSourceAutoRelease src = get_source();
-    if (!src)
-        return;
-
-    m_current.set(meta::STATUS, from_obs_state(obs_source_media_get_state(src)));
-
-    /* Prevent polling when vlc is stopped, which otherwise could cause a crash
-       when closing obs */
-    if (m_current.get<int>(meta::STATUS) == state_stopped)
-        return;
-
+    tags.clear();
     proc_handler_t* ph = obs_source_get_proc_handler(src);
 
     if (!ph)
@@ -230,77 +301,72 @@ void vlc_obs_source::refresh()
         return utf8_to_qt(result);
     };
 
-    m_current.set(meta::PROGRESS, (int)obs_source_media_get_time(src));
-    m_current.set(meta::DURATION, (int)obs_source_media_get_duration(src));
-
-    if (m_current.get<int>(meta::STATUS) <= state_paused) {
-#define check(t, d)              \
-    do {                         \
-        auto t = get_meta(#t);   \
-        if (t != "")             \
-            m_current.set(d, t); \
+#define check(t, d)            \
+    do {                       \
+        auto t = get_meta(#t); \
+        if (t != "")           \
+            tags.set(d, t);    \
     } while (0)
 
-#define check_num(t, d)              \
-    do {                             \
-        auto t = get_meta(#t);       \
-        if (t != "") {               \
-            bool ok = false;         \
-            auto i = t.toInt(&ok);   \
-            if (ok)                  \
-                m_current.set(d, i); \
-        }                            \
+#define check_num(t, d)            \
+    do {                           \
+        auto t = get_meta(#t);     \
+        if (t != "") {             \
+            bool ok = false;       \
+            auto i = t.toInt(&ok); \
+            if (ok)                \
+                tags.set(d, i);    \
+        }                          \
     } while (0)
 
-        // Some of these could technically be numbers
-        // like season or episode, but I think that VLC
-        // allows users to enter anything in there so we'll
-        // just use strings instead of assuming that it'll always be a number
-        check(artwork_url, meta::COVER);
-        check(title, meta::TITLE);
-        check(album, meta::ALBUM);
-        check(publisher, meta::LABEL);
-        check(genre, meta::GENRE);
-        check(copyright, meta::COPYRIGHT);
-        check(description, meta::DESCRIPTION);
-        check(rating, meta::RATING);
-        check(setting, meta::SETTING);
-        check(language, meta::LANGUAGE);
-        check(now_playing, meta::NOW_PLAYING);
-        check(encoded_by, meta::ENCODED_BY);
-        check(track_id, meta::TRACK_ID);
-        check(director, meta::DIRECTOR);
-        check(season, meta::SEASON);
-        check(episode, meta::EPISODE);
-        check(show_name, meta::SHOW_NAME);
-        check(actors, meta::ACTORS);
-        check(album_artist, meta::ALBUM_ARTIST);
-        check_num(track_number, meta::TRACK_NUMBER);
-        check_num(disc_number, meta::DISC_NUMBER);
-        check_num(track_total, meta::TRACK_TOTAL);
-        check_num(disc_total, meta::DISC_TOTAL);
-        check(url, meta::URL);
-
-        auto artist = get_meta("artist");
-        if (artist != "")
-            m_current.set(meta::ARTIST, QStringList(artist));
-
-        auto date = get_meta("date");
-        if (!date.isEmpty()) {
-            auto splits = date.split("-");
-
-            switch (splits.length()) {
-            case 3:
-                m_current.set(meta::RELEASE_DAY, splits[2].toInt());
-                [[fallthrough]];
-            case 2:
-                m_current.set(meta::RELEASE_MONTH, splits[1].toInt());
-                [[fallthrough]];
-            case 1:
-                m_current.set(meta::RELEASE_YEAR, splits[0].toInt());
-                break;
-            default:;
-            }
+    // Some of these could technically be numbers
+    // like season or episode, but I think that VLC
+    // allows users to enter anything in there so we'll
+    // just use strings instead of assuming that it'll always be a number
+    check(artwork_url, meta::COVER);
+    check(title, meta::TITLE);
+    check(album, meta::ALBUM);
+    check(publisher, meta::LABEL);
+    check(genre, meta::GENRE);
+    check(copyright, meta::COPYRIGHT);
+    check(description, meta::DESCRIPTION);
+    check(rating, meta::RATING);
+    check(setting, meta::SETTING);
+    check(language, meta::LANGUAGE);
+    check(now_playing, meta::NOW_PLAYING);
+    check(encoded_by, meta::ENCODED_BY);
+    check(track_id, meta::TRACK_ID);
+    check(director, meta::DIRECTOR);
+    check(season, meta::SEASON);
+    check(episode, meta::EPISODE);
+    check(show_name, meta::SHOW_NAME);
+    check(actors, meta::ACTORS);
+    check(album_artist, meta::ALBUM_ARTIST);
+    check_num(track_number, meta::TRACK_NUMBER);
+    check_num(disc_number, meta::DISC_NUMBER);
+    check_num(track_total, meta::TRACK_TOTAL);
+    check_num(disc_total, meta::DISC_TOTAL);
+    check(url, meta::URL);
+
+    auto artist = get_meta("artist");
+    if (artist != "")
+        tags.set(meta::ARTIST, QStringList(artist));
+
+    auto date = get_meta("date");
+    if (!date.isEmpty()) {
+        auto splits = date.split("-");
+
+        switch (splits.length()) {
+        case 3:
+            tags.set(meta::RELEASE_DAY, splits[2].toInt());
+            [[fallthrough]];
+        case 2:
+            tags.set(meta::RELEASE_MONTH, splits[1].toInt());
+            [[fallthrough]];
+        case 1:
+            tags.set(meta::RELEASE_YEAR, splits[0].toInt());
+            break;
+        default:;
         }
     }
 
@@ -309,6 +375,135 @@ void vlc_obs_source::refresh()
 #undef check_num
 }
 
+/* Returns false if the source was removed or renamed since it was attached,
+ * update_tracks() attaches it again */
+bool vlc_track::refresh(song& out)
+{
+    out.clear();
+    if (!weak_src)
+        return true;
+
+    /* we keep a reference here to make sure that this source won't be freed
+     * while we still need it */
+    OBSSourceAutoRelease src = obs_weak_source_get_source(weak_src);
+    if (!src || name != obs_source_get_name(src))
+        return false;
+
+    if (!obs_source_showing(src)) {
+        out.set(meta::STATUS, state_stopped);
+        return true;
+    }
+
+    auto state = from_obs_state(obs_source_media_get_state(src));
+
+    /* Prevent polling when vlc is stopped, which otherwise could cause a crash
+       when closing obs */
+    if (state == state_stopped) {
+        out.set(meta::STATUS, state);
+        return true;
+    }
+
+    auto duration = (int)obs_source_media_get_duration(src);
+    if (state <= state_paused) {
+        /* VLC parses the tags of a new item in the background, they're
+         * usually complete once the duration is known, so a changed
+         * duration also means that the tags have to be read again */
+        if (tags_dirty.exchange(false) || duration != tags_duration) {
+            read_tags(src);
+            tags_duration = duration;
+        }
+        out = tags;
+    }
+
+    out.set(meta::STATUS, state);
+    out.set(meta::PROGRESS, (int)obs_source_media_get_time(src));
+    out.set(meta::DURATION, duration);
+    return true;
+}
+
+void vlc_obs_source::refresh()
+{
+    begin_refresh();
+    m_current.clear();
+    if (!util::have_vlc_source)
+        return;
+
+    if (m_target_dirty.exchange(false))
+        update_tracks();
+
+    std::vector<vlc_track*> tracks;
+    {
+        std::lock_guard<std::mutex> lock(m_tracks_mutex);
+        m_refresh_count++;
+        for (auto it = m_requested.begin(); it != m_requested.end();) {
+            if (m_refresh_count - it->second > REQUEST_TIMEOUT) {
+                it = m_requested.erase(it);
+                m_target_dirty = true;
+            } else {
+                ++it;
+            }
+        }
+        for (auto const& [name, track] : m_tracks)
+            tracks.push_back(track.get());
+    }
+
+    /* Only this thread adds or removes tracks, so they can be refreshed
+     * without the lock. Reading the tags makes a lot of calls into the VLC
+     * source and song_for() is called from the video thread */
+    std::vector<song> songs(tracks.size());
+    bool target_lost = false;
+    for (size_t i = 0; i < tracks.size(); i++) {
+        if (tracks[i]->refresh(songs[i]))
+            continue;
+        /* Look for it again in the next refresh */
+        m_target_dirty = true;
+        target_lost |= tracks[i]->name == m_target_source_name;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_tracks_mutex);
+        for (size_t i = 0; i < tracks.size(); i++)
+            tracks[i]->current = std::move(songs[i]);
+        auto it = m_tracks.find(m_target_source_name);
+        if (it != m_tracks.end())
+            m_current = it->second->current;
+    }
+
+    if (target_lost)
+        get_ui<vlc>()->rebuild_mapping();
+}
+
+bool vlc_obs_source::needs_refresh()
+{
+    std::lock_guard<std::mutex> lock(m_tracks_mutex);
+    return !m_requested.empty() || !m_output_names.empty();
+}
+
+song vlc_obs_source::song_for(std::string const& name)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_tracks_mutex);
+        auto inserted = m_requested.insert_or_assign(name, m_refresh_count).second;
+        auto it = m_tracks.find(name);
+        if (it != m_tracks.end())
+            return it->second->current;
+        if (!inserted)
+            return {};
+    }
+    m_target_dirty = true;
+    tuna_thread::wake(this);
+    return {};
+}
+
+obs_source_t* vlc_obs_source::get_source()
+{
+    std::lock_guard<std::mutex> lock(m_tracks_mutex);
+    auto it = m_tracks.find(m_target_source_name);
+    if (it == m_tracks.end())
+        return nullptr;
+    return obs_weak_source_get_source(it->second->weak_src);
+}
+
 bool vlc_obs_source::execute_capability(capability c)
 {
     OBSSourceAutoRelease src = get_source();
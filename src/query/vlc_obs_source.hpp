@@ -19,29 +19,80 @@
 #pragma once
 #include "music_source.hpp"
 #include <QString>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <obs-frontend-api.h>
 #include <obs-module.h>
 #include <obs.hpp>
+#include <set>
+
+class vlc_obs_source;
+
+/* A VLC source that is followed by name. Its media signals are connected, so
+ * the tags are only read once VLC starts another item, every refresh only
+ * polls time and state. Tracks are only added, removed and refreshed by the
+ * query thread, weak_src is only changed and current only read or written
+ * with the tracks mutex held */
+struct vlc_track {
+    vlc_obs_source* owner;
+    std::string name;
+    OBSWeakSourceAutoRelease weak_src {};
+    song tags {};
+    int tags_duration = -1;
+    std::atomic<bool> tags_dirty { true };
+    song current {};
+
+    vlc_track(vlc_obs_source* o, std::string const& n)
+        : owner(o)
+        , name(n)
+    {
+    }
+    ~vlc_track() { detach(); }
+
+    static void media_changed(void* data, calldata_t* cd);
+    /* Finds the source by its name and connects to its signals */
+    void attach();
+    void detach();
+    bool attached_to_name();
+    void read_tags(obs_source_t* src);
+    bool refresh(song& out);
+};
 
 class vlc_obs_source : public music_source {
+    friend struct vlc_track;
+
     std::string m_target_source_name {};
     std::string m_target_scene {};
-    OBSWeakSourceAutoRelease m_weak_src {};
-    bool reload();
 
-    void load_vlc_source();
+    /* All VLC sources that are mapped to the current scene or that an
+     * output refers to, the target is one of them */
+    std::map<std::string, std::unique_ptr<vlc_track>> m_tracks;
+    std::mutex m_tracks_mutex;
+
+    /* Names that were asked for with the refresh they were last asked for
+     * in, names that aren't used anymore (e.g. while a format is typed) are
+     * dropped again. Log outputs only format once per song, so the names in
+     * the formats of the outputs are always kept */
+    std::map<std::string, uint64_t> m_requested;
+    std::set<std::string> m_output_names;
+    uint64_t m_refresh_count = 0;
+
+    /* Tracks and the target are only resolved again once the scene, the
+     * mappings or any VLC source changed */
+    std::atomic<bool> m_target_dirty { true };
+
+    static void frontend_event(enum obs_frontend_event event, void* data);
+    static void sources_changed(void* data, calldata_t* cd);
+    std::string resolve_target_source_name();
+    void update_tracks();
 
-    std::string get_target_source_name();
     std::string get_current_scene_name();
     int m_index = 0;
 
     // Gets the currently tracked obs vlc source with increased ref count
-    obs_source_t* get_source()
-    {
-        auto* src = obs_weak_source_get_source(m_weak_src);
-        if (!src)
-            m_weak_src = {};
-        return src;
-    }
+    obs_source_t* get_source();
 
 public:
     vlc_obs_source();
@@ -49,9 +100,17 @@ public:
 
     void load() override;
     void refresh() override;
+    refresh_cadence cadence() const override { return { 200, 100, true }; }
     bool execute_capability(capability c) override;
     bool enabled() const override;
 
+    /* Outputs that refer to a VLC source by name keep it refreshed */
+    bool needs_refresh() override;
+
+    /* Song of a VLC source by its name, it's followed from the next
+     * refresh on if it wasn't already */
+    song song_for(std::string const& name);
+
     void next_vlc_source();
     void prev_vlc_source();
     void set_gui_values() override;
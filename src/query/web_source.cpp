@@ -17,6 +17,7 @@
  *************************************************************************/
 
 #include "web_source.hpp"
+#include "../util/config.hpp"
 #include "../util/constants.hpp"
 #include "../util/web_server.hpp"
 
@@ -26,6 +27,12 @@ web_source::web_source()
     supported_metadata({ meta::ARTIST, meta::TITLE, meta::ALBUM, meta::PROGRESS, meta::DURATION, meta::COVER });
 }
 
+/* Refreshed as soon as the browser posts new information */
+refresh_cadence web_source::cadence() const
+{
+    return { config::refresh_rate, 50, true };
+}
+
 void web_source::refresh()
 {
     begin_refresh();
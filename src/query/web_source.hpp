@@ -24,6 +24,7 @@ public:
     web_source();
 
     void refresh() override;
+    refresh_cadence cadence() const override;
     bool execute_capability(capability c) override;
     bool enabled() const override;
 };
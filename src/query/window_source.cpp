@@ -23,7 +23,8 @@
 #include "../util/constants.hpp"
 #include "../util/utility.hpp"
 #include "../util/window/window_helper.hpp"
-#include <QRegularExpression>
+#include <QJsonArray>
+#include <QJsonDocument>
 
 window_source::window_source()
     : music_source(S_SOURCE_WINDOW_TITLE, T_SOURCE_WINDOW_TITLE, new window_title)
@@ -31,6 +32,52 @@ window_source::window_source()
     supported_metadata({ meta::TITLE });
 }
 
+window_rule::window_rule(const QJsonObject& rule)
+{
+    m_title = qt_to_utf8(rule["title"].toString());
+    m_pause = qt_to_utf8(rule["pause"].toString());
+    m_search = qt_to_utf8(rule["search"].toString());
+    m_replace = qt_to_utf8(rule["replace"].toString());
+    m_cut_begin = uint16_t(rule["cut_begin"].toInt());
+    m_cut_end = uint16_t(rule["cut_end"].toInt());
+    m_use_regex = rule["regex"].toBool();
+
+    if (m_use_regex) {
+        m_regex.setPattern(rule["title"].toString());
+        if (m_regex.isValid())
+            m_regex.optimize(); /* Compiles the pattern right away, with JIT if available */
+        else
+            berr("Invalid window title regex '%s': %s", m_title.c_str(), qt_to_utf8(m_regex.errorString()));
+    }
+}
+
+bool window_rule::matches(const std::string& title) const
+{
+    /* QRegularExpression only works on utf-16, so regex rules still need
+     * a conversion per title */
+    if (m_use_regex)
+        return m_regex.match(utf8_to_qt(title.c_str())).hasMatch();
+
+    /* Direct search */
+    if (title.find(m_title) == std::string::npos)
+        return false;
+    return m_pause.empty() || title.find(m_pause) != std::string::npos;
+}
+
+QString window_rule::apply(std::string title) const
+{
+    if (!m_search.empty()) {
+        for (auto pos = title.find(m_search); pos != std::string::npos; pos = title.find(m_search, pos + m_replace.length()))
+            title.replace(pos, m_search.length(), m_replace);
+    }
+
+    /* Cutting is done on characters, not bytes */
+    auto result = utf8_to_qt(title.c_str());
+    if (0 < m_cut_end + m_cut_begin && m_cut_end + m_cut_begin < result.length())
+        result = result.mid(m_cut_begin, result.length() - m_cut_begin - m_cut_end);
+    return result;
+}
+
 bool window_source::enabled() const
 {
     return true;
@@ -49,68 +96,62 @@ void window_source::load()
     CDEF_STR(CFG_WINDOW_PROCESS_NAME, "");
     CDEF_BOOL(CFG_WINDOW_USE_PROCRESS, false);
 
-    m_title = utf8_to_qt(CGET_STR(CFG_WINDOW_TITLE));
-    m_regex = CGET_BOOL(CFG_WINDOW_REGEX);
-    m_search = utf8_to_qt(CGET_STR(CFG_WINDOW_SEARCH));
-    m_replace = utf8_to_qt(CGET_STR(CFG_WINDOW_REPLACE));
-    m_pause = utf8_to_qt(CGET_STR(CFG_WINDOW_PAUSE));
-    m_cut_begin = CGET_UINT(CFG_WINDOW_CUT_BEGIN);
-    m_cut_end = CGET_UINT(CFG_WINDOW_CUT_END);
     m_use_process_name = CGET_BOOL(CFG_WINDOW_USE_PROCRESS);
-    m_process_name = utf8_to_qt(CGET_STR(CFG_WINDOW_PROCESS_NAME));
-}
+    m_process_name = CGET_STR(CFG_WINDOW_PROCESS_NAME);
 
-QString window_source::get_title(const std::vector<std::string>& windows)
-{
-    QRegularExpression regex(m_title);
-    QString result = "";
-
-    for (const auto& title : windows) {
-        bool matches = false;
-        if (m_regex) {
-            matches = regex.match(title.c_str()).hasMatch();
-        } else {
-            /* Direct search */
-            QString tmp(title.c_str());
-            matches = tmp.contains(m_title);
-            if (matches && !m_pause.isEmpty() && !tmp.contains(m_pause))
-                matches = false;
-        }
+    /* The rule from the settings tab comes first, followed by any additional
+     * rules from the rule file */
+    QJsonObject rule;
+    rule["title"] = utf8_to_qt(CGET_STR(CFG_WINDOW_TITLE));
+    rule["regex"] = CGET_BOOL(CFG_WINDOW_REGEX);
+    rule["search"] = utf8_to_qt(CGET_STR(CFG_WINDOW_SEARCH));
+    rule["replace"] = utf8_to_qt(CGET_STR(CFG_WINDOW_REPLACE));
+    rule["pause"] = utf8_to_qt(CGET_STR(CFG_WINDOW_PAUSE));
+    rule["cut_begin"] = int(CGET_UINT(CFG_WINDOW_CUT_BEGIN));
+    rule["cut_end"] = int(CGET_UINT(CFG_WINDOW_CUT_END));
+
+    m_rules.clear();
+    m_rules.emplace_back(rule);
 
-        if (matches) {
-            result = title.c_str();
-            break;
+    QJsonDocument doc;
+    if (util::open_config(WINDOW_RULES, doc) && doc.isArray()) {
+        for (const auto& r : doc.array()) {
+            if (r.isObject())
+                m_rules.emplace_back(r.toObject());
         }
     }
-    return result;
 }
 
-QString window_source::get_title(const std::vector<std::pair<std::string, std::string>>& processes)
+bool window_source::get_title(const std::vector<std::string>& windows, QString& result) const
 {
-    QString result = "";
-    for (const auto& p : processes) {
-        if (utf8_to_qt(p.first.c_str()) == m_process_name) {
-            result = utf8_to_qt(p.second.c_str());
-            break;
+    for (const auto& rule : m_rules) {
+        if (!rule.valid())
+            continue;
+        for (const auto& title : windows) {
+            if (rule.matches(title)) {
+                result = rule.apply(title);
+                return true;
+            }
         }
     }
-    return result;
+    return false;
 }
 
 void window_source::refresh()
 {
-    if (m_title.isEmpty())
+    if (m_use_process_name && m_process_name.empty())
         return;
     QString result;
 
     if (m_use_process_name) {
-        std::vector<std::pair<std::string, std::string>> processes;
-        GetWindowAndExeList(processes);
-        result = get_title(processes);
+        std::vector<std::string> titles;
+        GetWindowTitlesForExe(m_process_name, titles);
+        if (!titles.empty())
+            result = m_rules[0].apply(titles[0]);
     } else {
         std::vector<std::string> windows;
         GetWindowList(windows);
-        result = get_title(windows);
+        get_title(windows, result);
     }
 
     begin_refresh();
@@ -118,11 +159,6 @@ void window_source::refresh()
     if (result.isEmpty()) {
         m_current.set(meta::STATUS, state_stopped);
     } else {
-        /* Replace & cut */
-        result.replace(m_search, m_replace);
-        if (0 < m_cut_end + m_cut_begin && m_cut_end + m_cut_begin < result.length())
-            result = result.mid(m_cut_begin, result.length() - m_cut_begin - m_cut_end);
-
         m_current.set(meta::STATUS, state_playing);
         m_current.set(meta::TITLE, result);
     }
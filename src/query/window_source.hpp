@@ -19,19 +19,37 @@
 #pragma once
 
 #include "music_source.hpp"
+#include <QJsonObject>
+#include <QRegularExpression>
 #include <string>
 #include <utility>
 #include <vector>
 
+/* A single title rule, compiled once when the config is loaded. Plain
+ * rules work directly on the utf-8 window titles */
+class window_rule {
+    std::string m_title, m_pause, m_search, m_replace;
+    QRegularExpression m_regex;
+    uint16_t m_cut_begin = 0, m_cut_end = 0;
+    bool m_use_regex = false;
+
+public:
+    window_rule(const QJsonObject& rule);
+
+    bool valid() const { return !m_title.empty() && (!m_use_regex || m_regex.isValid()); }
+    bool matches(const std::string& title) const;
+    /* Search & replace and cut */
+    QString apply(std::string title) const;
+};
+
 class window_source : public music_source {
-    QString m_title = "";
-    QString m_process_name = "";
-    QString m_search = "", m_replace = "", m_pause = "";
-    uint16_t m_cut_begin = 0, m_cut_end;
-    bool m_regex = false, m_use_process_name;
-
-    QString get_title(const std::vector<std::string>& windows);
-    QString get_title(const std::vector<std::pair<std::string, std::string>>& processes);
+    std::string m_process_name = "";
+    bool m_use_process_name;
+
+    /* Checked in order, the first rule that matches any window wins */
+    std::vector<window_rule> m_rules;
+
+    bool get_title(const std::vector<std::string>& windows, QString& result) const;
 
 public:
     window_source();
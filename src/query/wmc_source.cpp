@@ -20,6 +20,8 @@
 #include "../gui/widgets/wmc.hpp"
 #include "../util/config.hpp"
 #include "../util/constants.hpp"
+#include "../util/cover_pipeline.hpp"
+#include "../util/tuna_thread.hpp"
 #include "../util/utility.hpp"
 #include <QFile>
 
@@ -93,17 +95,8 @@ void wmc_source::update_players()
 
 void wmc_source::save_cover(QImage const& image)
 {
-    auto tmp = config::cover_path + ".tmp";
-
-    if (image.save(tmp, "png")) {
-        QFile current(config::cover_path);
-        current.remove();
-        if (!QFile::rename(tmp, config::cover_path)) {
-            util::reset_cover();
-            berr("[WMC] Failed to move cover from temporary file to %s", qt_to_utf8(config::cover_path));
-        }
-
-    } else {
+    if (!cover_pipeline::submit(image)) {
+        util::reset_cover();
         berr("[WMC] Failed to save cover to %s", qt_to_utf8(config::cover_path));
     }
 }
@@ -188,6 +181,7 @@ void wmc_source::handle_media_property_change(GlobalSystemMediaTransportControls
         m_info[id].set<int>(meta::PROGRESS, progress_ms);
         m_info[id].set<int>(meta::DURATION, duration_ms);
     }
+    tuna_thread::wake(this);
 
     auto thumbnail = media_properties.Thumbnail();
     com_array<uint8_t> pixel_data_detached;
@@ -237,7 +231,7 @@ void wmc_source::handle_media_property_change(GlobalSystemMediaTransportControls
         /* We receive cover updates regardless of whether tuna is
          * configured to monitor WMC so if the current source isn't WMC, we
          * just save the cover for when the user switches to WMC*/
-        if (current_source.get() == this) {
+        if (current_source && current_source->active() == this) {
             save_cover(image);
         }
     }
@@ -265,6 +259,7 @@ void wmc_source::handle_media_playback_info_change(GlobalSystemMediaTransportCon
         m_info[id].set(meta::STATUS, play_state::state_stopped);
         break;
     }
+    tuna_thread::wake(this);
 }
 
 void wmc_source::handle_timeline_property_change(GlobalSystemMediaTransportControlsSession session, TimelinePropertiesChangedEventArgs const& args)
@@ -301,6 +296,12 @@ wmc_source::wmc_source()
     }).detach();
 }
 
+/* Media and playback changes are pushed, the position is still polled */
+refresh_cadence wmc_source::cadence() const
+{
+    return { config::refresh_rate, 50, true };
+}
+
 void wmc_source::refresh()
 {
     music_source::begin_refresh();
@@ -56,6 +56,8 @@ public:
     ~wmc_source() = default;
 
     void refresh() override;
+    /* Changes are received through callbacks, refreshes only pick up the progress */
+    refresh_cadence cadence() const override;
     void handle_media_property_change(GlobalSystemMediaTransportControlsSession session, MediaPropertiesChangedEventArgs const& arg);
     void handle_media_playback_info_change(GlobalSystemMediaTransportControlsSession session, PlaybackInfoChangedEventArgs const& args);
     void handle_timeline_property_change(GlobalSystemMediaTransportControlsSession session, TimelinePropertiesChangedEventArgs const& args);
@@ -0,0 +1,180 @@
+/*************************************************************************
+ * This file is part of tuna
+ * git.vrsal.xyz/alex/tuna
+ * Copyright 2023 univrsal <uni@vrsal.xyz>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#include "cover.hpp"
+#include "../util/constants.hpp"
+#include "../util/cover_pipeline.hpp"
+#include "../util/utility.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace obs_sources {
+cover_source::cover_source(obs_data_t* settings)
+{
+    auto* path = obs_module_file("effects/crossfade.effect");
+    obs_enter_graphics();
+    m_effect = gs_effect_create_from_file(path, nullptr);
+    obs_leave_graphics();
+    bfree(path);
+
+    if (!m_effect)
+        berr("Failed to load the crossfade effect, covers will be stretched and won't fade");
+    update(settings);
+}
+
+cover_source::~cover_source()
+{
+    obs_enter_graphics();
+    gs_texture_destroy(m_tex);
+    gs_texture_destroy(m_prev_tex);
+    gs_effect_destroy(m_effect);
+    obs_leave_graphics();
+}
+
+void cover_source::upload()
+{
+    auto image = cover_pipeline::current(nullptr, &m_identity);
+
+    /* Qt's 32 bit formats are BGRA in memory on little endian machines */
+    auto format = GS_BGRX;
+    if (!image.isNull() && image.format() != QImage::Format_RGB32) {
+        image = image.convertToFormat(QImage::Format_ARGB32);
+        format = GS_BGRA;
+    }
+
+    obs_enter_graphics();
+    gs_texture_t* tex = nullptr;
+    if (!image.isNull()) {
+        const uint8_t* data = image.constBits();
+        tex = gs_texture_create(image.width(), image.height(), format, 1, &data, 0);
+    }
+
+    gs_texture_destroy(m_prev_tex);
+    m_prev_tex = nullptr;
+    if (m_effect && m_fade_ms > 0 && m_tex && tex) {
+        m_prev_tex = m_tex;
+        m_fade = 0.f;
+    } else {
+        gs_texture_destroy(m_tex);
+        m_fade = 1.f;
+    }
+    m_tex = tex;
+    obs_leave_graphics();
+}
+
+void cover_source::tick(float seconds)
+{
+    if (cover_pipeline::identity() != m_identity)
+        upload();
+
+    if (m_prev_tex) {
+        m_fade += seconds * 1000.f / float(std::max<uint32_t>(m_fade_ms, 1));
+        if (m_fade >= 1.f) {
+            m_fade = 1.f;
+            obs_enter_graphics();
+            gs_texture_destroy(m_prev_tex);
+            obs_leave_graphics();
+            m_prev_tex = nullptr;
+        }
+    }
+}
+
+/* Offset and size of the texture inside the source in texture coordinates,
+ * the cover is scaled to fit and centered */
+static void fit(gs_texture_t* tex, uint32_t cx, uint32_t cy, struct vec4* out)
+{
+    auto tw = float(gs_texture_get_width(tex)), th = float(gs_texture_get_height(tex));
+    auto scale = fminf(float(cx) / tw, float(cy) / th);
+    auto w = tw * scale / float(cx), h = th * scale / float(cy);
+    vec4_set(out, (1.f - w) / 2.f, (1.f - h) / 2.f, w, h);
+}
+
+void cover_source::render(gs_effect_t* effect)
+{
+    UNUSED_PARAMETER(effect);
+    if (!m_tex)
+        return;
+
+    if (!m_effect) {
+        auto* def = obs_get_base_effect(OBS_EFFECT_DEFAULT);
+        gs_effect_set_texture(gs_effect_get_param_by_name(def, "image"), m_tex);
+        while (gs_effect_loop(def, "Draw"))
+            gs_draw_sprite(m_tex, 0, m_cx, m_cy);
+        return;
+    }
+
+    /* Without a previous cover it just fades between the same texture */
+    auto* prev = m_prev_tex ? m_prev_tex : m_tex;
+    struct vec4 rect, prev_rect;
+    fit(m_tex, m_cx, m_cy, &rect);
+    fit(prev, m_cx, m_cy, &prev_rect);
+
+    gs_effect_set_texture(gs_effect_get_param_by_name(m_effect, "image"), m_tex);
+    gs_effect_set_texture(gs_effect_get_param_by_name(m_effect, "prev_image"), prev);
+    gs_effect_set_vec4(gs_effect_get_param_by_name(m_effect, "image_rect"), &rect);
+    gs_effect_set_vec4(gs_effect_get_param_by_name(m_effect, "prev_rect"), &prev_rect);
+    gs_effect_set_float(gs_effect_get_param_by_name(m_effect, "fade"), m_fade);
+
+    while (gs_effect_loop(m_effect, "Draw"))
+        gs_draw_sprite(nullptr, 0, m_cx, m_cy);
+}
+
+void cover_source::update(obs_data_t* settings)
+{
+    m_cx = static_cast<uint32_t>(obs_data_get_int(settings, S_COVER_CX));
+    m_cy = static_cast<uint32_t>(obs_data_get_int(settings, S_COVER_CY));
+    m_fade_ms = static_cast<uint32_t>(obs_data_get_int(settings, S_COVER_FADE));
+}
+
+obs_properties_t* get_properties_for_cover(void* data)
+{
+    UNUSED_PARAMETER(data);
+    auto* p = obs_properties_create();
+    obs_properties_add_int(p, S_COVER_CX, T_COVER_CX, 2, UINT16_MAX, 1);
+    obs_properties_add_int(p, S_COVER_CY, T_COVER_CY, 2, UINT16_MAX, 1);
+    obs_properties_add_int(p, S_COVER_FADE, T_COVER_FADE, 0, 10000, 50);
+    return p;
+}
+
+void register_cover()
+{
+    obs_source_info si {};
+    si.id = S_COVER_ID;
+    si.type = OBS_SOURCE_TYPE_INPUT;
+    si.output_flags = OBS_SOURCE_VIDEO | OBS_SOURCE_CUSTOM_DRAW;
+    si.get_properties = get_properties_for_cover;
+    si.get_name = [](void*) { return T_COVER_NAME; };
+    si.create = [](obs_data_t* d, obs_source_t*) { return static_cast<void*>(new cover_source(d)); };
+    si.destroy = [](void* data) { delete reinterpret_cast<cover_source*>(data); };
+    si.get_width = [](void* data) { return reinterpret_cast<cover_source*>(data)->get_width(); };
+    si.get_height = [](void* data) { return reinterpret_cast<cover_source*>(data)->get_height(); };
+    si.get_defaults = [](obs_data_t* settings) {
+        obs_data_set_default_int(settings, S_COVER_CX, 300);
+        obs_data_set_default_int(settings, S_COVER_CY, 300);
+        obs_data_set_default_int(settings, S_COVER_FADE, 500);
+    };
+
+    si.update = [](void* data, obs_data_t* settings) { reinterpret_cast<cover_source*>(data)->update(settings); };
+    si.video_tick = [](void* data, float seconds) { reinterpret_cast<cover_source*>(data)->tick(seconds); };
+    si.video_render = [](void* data, gs_effect_t* effect) {
+        reinterpret_cast<cover_source*>(data)->render(effect);
+    };
+
+    obs_register_source(&si);
+}
+}
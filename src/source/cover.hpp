@@ -0,0 +1,51 @@
+/*************************************************************************
+ * This file is part of tuna
+ * git.vrsal.xyz/alex/tuna
+ * Copyright 2023 univrsal <uni@vrsal.xyz>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#pragma once
+#include <obs-module.h>
+
+namespace obs_sources {
+
+/* Shows the current cover straight from the cover pipeline instead of
+ * reading the cover file. A texture is only uploaded once the cover changed
+ * and the previous one can be faded out on the GPU */
+class cover_source {
+    gs_effect_t* m_effect = nullptr;
+    gs_texture_t* m_tex = nullptr;
+    gs_texture_t* m_prev_tex = nullptr;
+    uint32_t m_cx = 300, m_cy = 300;
+    uint32_t m_fade_ms = 0;
+    float m_fade = 1.f;
+    uint64_t m_identity = 0;
+
+    void upload();
+
+public:
+    explicit cover_source(obs_data_t* settings);
+    ~cover_source();
+
+    inline void update(obs_data_t* settings);
+    inline void tick(float seconds);
+    inline void render(gs_effect_t* effect);
+
+    uint32_t get_width() const { return m_cx; }
+    uint32_t get_height() const { return m_cy; }
+};
+
+extern void register_cover();
+}
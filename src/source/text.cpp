@@ -0,0 +1,231 @@
+/*************************************************************************
+ * This file is part of tuna
+ * git.vrsal.xyz/alex/tuna
+ * Copyright 2023 univrsal <uni@vrsal.xyz>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#include "text.hpp"
+#include "../util/constants.hpp"
+#include "../util/format.hpp"
+#include "../util/lyrics_handler.hpp"
+#include "../util/tuna_thread.hpp"
+#include <QFontMetrics>
+#include <QImage>
+#include <QPainter>
+#include <algorithm>
+#include <cmath>
+
+namespace obs_sources {
+text_source::text_source(obs_source_t* src, obs_data_t* settings)
+    : m_source(src)
+{
+    update(settings);
+}
+
+text_source::~text_source()
+{
+    obs_enter_graphics();
+    gs_texture_destroy(m_tex);
+    obs_leave_graphics();
+}
+
+void text_source::rasterize(uint32_t color)
+{
+    QImage img;
+    if (!m_text.isEmpty()) {
+        auto flags = Qt::AlignLeft | Qt::TextExpandTabs;
+        auto rect = QFontMetrics(m_font).boundingRect(QRect(), flags, m_text);
+        if (rect.width() > 0 && rect.height() > 0) {
+            img = QImage(rect.width(), rect.height(), QImage::Format_RGBA8888);
+            img.fill(Qt::transparent);
+
+            /* obs colors are stored as 0xAABBGGRR */
+            QPainter p(&img);
+            p.setRenderHint(QPainter::TextAntialiasing);
+            p.setFont(m_font);
+            p.setPen(QColor(color & 0xff, (color >> 8) & 0xff, (color >> 16) & 0xff, (color >> 24) & 0xff));
+            p.drawText(img.rect(), flags, m_text);
+        }
+    }
+
+    obs_enter_graphics();
+    gs_texture_destroy(m_tex);
+    m_tex = nullptr;
+    if (!img.isNull()) {
+        const uint8_t* data = img.constBits();
+        m_tex = gs_texture_create(img.width(), img.height(), GS_RGBA, 1, &data, 0);
+    }
+    obs_leave_graphics();
+
+    m_tex_cx = m_tex ? img.width() : 0;
+    m_tex_cy = m_tex ? img.height() : 0;
+}
+
+void text_source::tick(float seconds)
+{
+    if (!obs_source_showing(m_source))
+        return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    /* Only format again once the query thread made a new copy or the
+     * lyrics line changed */
+    bool changed = m_dirty;
+    tuna_thread::copy_mutex.lock();
+    if (tuna_thread::copy_version != m_version) {
+        m_song = tuna_thread::copy;
+        m_version = tuna_thread::copy_version;
+        changed = true;
+    }
+    tuna_thread::copy_mutex.unlock();
+
+    /* Lines change in between queries */
+    if (m_uses_lyrics) {
+        auto version = lyrics::line_version();
+        if (version != m_lyrics_version) {
+            m_lyrics_version = version;
+            changed = true;
+        }
+    }
+
+    if (changed) {
+        auto text = m_format;
+        format::execute(text, m_song);
+        if (m_dirty || text != m_text) {
+            m_text = text;
+            rasterize(m_color);
+            m_offset = 0.f;
+        }
+        m_dirty = false;
+    }
+
+    m_width = m_cx > 0 ? m_cx : m_tex_cx;
+    if (m_marquee && m_tex_cx > m_width)
+        m_offset = fmodf(m_offset + seconds * m_speed, float(m_tex_cx + m_gap));
+    else
+        m_offset = 0.f;
+}
+
+void text_source::render(gs_effect_t* effect)
+{
+    if (!m_tex || m_width == 0)
+        return;
+
+    gs_effect_set_texture(gs_effect_get_param_by_name(effect, "image"), m_tex);
+
+    /* The visible part of the text starting at the scroll offset, followed
+     * by its beginning again once the end scrolled into view */
+    auto offset = static_cast<uint32_t>(m_offset);
+    if (offset < m_tex_cx) {
+        auto cx = std::min(m_tex_cx - offset, m_width);
+        while (gs_effect_loop(effect, "Draw"))
+            gs_draw_sprite_subregion(m_tex, 0, offset, 0, cx, m_tex_cy);
+    }
+
+    if (offset > 0) {
+        auto x = m_tex_cx + m_gap - offset;
+        if (x < m_width) {
+            gs_matrix_push();
+            gs_matrix_translate3f(float(x), 0, 0);
+            while (gs_effect_loop(effect, "Draw"))
+                gs_draw_sprite_subregion(m_tex, 0, 0, 0, std::min(m_width - x, m_tex_cx), m_tex_cy);
+            gs_matrix_pop();
+        }
+    }
+}
+
+void text_source::update(obs_data_t* settings)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_format = utf8_to_qt(obs_data_get_string(settings, S_TEXT_FORMAT));
+    m_uses_lyrics = m_format.contains("lyrics_line") || m_format.contains("lyrics_next");
+    m_color = static_cast<uint32_t>(obs_data_get_int(settings, S_TEXT_COLOR));
+    m_cx = static_cast<uint32_t>(obs_data_get_int(settings, S_TEXT_CX));
+    m_marquee = obs_data_get_bool(settings, S_TEXT_MARQUEE);
+    m_speed = static_cast<float>(obs_data_get_int(settings, S_TEXT_SPEED));
+    m_gap = static_cast<uint32_t>(obs_data_get_int(settings, S_TEXT_GAP));
+
+    auto* font = obs_data_get_obj(settings, S_TEXT_FONT);
+    auto flags = obs_data_get_int(font, "flags");
+    m_font = QFont(utf8_to_qt(obs_data_get_string(font, "face")));
+    m_font.setPixelSize(qMax(1, int(obs_data_get_int(font, "size"))));
+    m_font.setBold(flags & OBS_FONT_BOLD);
+    m_font.setItalic(flags & OBS_FONT_ITALIC);
+    m_font.setUnderline(flags & OBS_FONT_UNDERLINE);
+    m_font.setStrikeOut(flags & OBS_FONT_STRIKEOUT);
+    obs_data_release(font);
+    m_dirty = true;
+}
+
+static bool marquee_changed(obs_properties_t* props, obs_property_t* property, obs_data_t* settings)
+{
+    UNUSED_PARAMETER(property);
+    auto marquee = obs_data_get_bool(settings, S_TEXT_MARQUEE);
+    obs_property_set_visible(obs_properties_get(props, S_TEXT_SPEED), marquee);
+    obs_property_set_visible(obs_properties_get(props, S_TEXT_GAP), marquee);
+    return true;
+}
+
+obs_properties_t* get_properties_for_text(void* data)
+{
+    UNUSED_PARAMETER(data);
+    auto* p = obs_properties_create();
+    obs_properties_add_text(p, S_TEXT_FORMAT, T_TEXT_FORMAT, OBS_TEXT_MULTILINE);
+    obs_properties_add_font(p, S_TEXT_FONT, T_TEXT_FONT);
+    obs_properties_add_color_alpha(p, S_TEXT_COLOR, T_TEXT_COLOR);
+    obs_properties_add_int(p, S_TEXT_CX, T_TEXT_CX, 0, UINT16_MAX, 1);
+    auto* marquee = obs_properties_add_bool(p, S_TEXT_MARQUEE, T_TEXT_MARQUEE);
+    obs_property_set_modified_callback(marquee, marquee_changed);
+    obs_properties_add_int(p, S_TEXT_SPEED, T_TEXT_SPEED, 1, 1000, 1);
+    obs_properties_add_int(p, S_TEXT_GAP, T_TEXT_GAP, 0, UINT16_MAX, 1);
+    return p;
+}
+
+void register_text()
+{
+    obs_source_info si {};
+    si.id = S_TEXT_ID;
+    si.type = OBS_SOURCE_TYPE_INPUT;
+    si.output_flags = OBS_SOURCE_VIDEO;
+    si.get_properties = get_properties_for_text;
+    si.get_name = [](void*) { return T_TEXT_NAME; };
+    si.create = [](obs_data_t* d, obs_source_t* s) { return static_cast<void*>(new text_source(s, d)); };
+    si.destroy = [](void* data) { delete reinterpret_cast<text_source*>(data); };
+    si.get_width = [](void* data) { return reinterpret_cast<text_source*>(data)->get_width(); };
+    si.get_height = [](void* data) { return reinterpret_cast<text_source*>(data)->get_height(); };
+    si.get_defaults = [](obs_data_t* settings) {
+        auto* font = obs_data_create();
+        obs_data_set_default_string(font, "face", "Arial");
+        obs_data_set_default_int(font, "size", 48);
+        obs_data_set_default_obj(settings, S_TEXT_FONT, font);
+        obs_data_release(font);
+
+        obs_data_set_default_string(settings, S_TEXT_FORMAT, "{artist} - {title}");
+        obs_data_set_default_int(settings, S_TEXT_COLOR, 0xFFFFFFFF);
+        obs_data_set_default_int(settings, S_TEXT_CX, 0);
+        obs_data_set_default_bool(settings, S_TEXT_MARQUEE, false);
+        obs_data_set_default_int(settings, S_TEXT_SPEED, 50);
+        obs_data_set_default_int(settings, S_TEXT_GAP, 50);
+    };
+
+    si.update = [](void* data, obs_data_t* settings) { reinterpret_cast<text_source*>(data)->update(settings); };
+    si.video_tick = [](void* data, float seconds) { reinterpret_cast<text_source*>(data)->tick(seconds); };
+    si.video_render = [](void* data, gs_effect_t* effect) {
+        reinterpret_cast<text_source*>(data)->render(effect);
+    };
+
+    obs_register_source(&si);
+}
+}
@@ -0,0 +1,71 @@
+/*************************************************************************
+ * This file is part of tuna
+ * git.vrsal.xyz/alex/tuna
+ * Copyright 2023 univrsal <uni@vrsal.xyz>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#pragma once
+#include "../query/song.hpp"
+#include <QFont>
+#include <QString>
+#include <mutex>
+#include <obs-module.h>
+
+namespace obs_sources {
+
+/* Renders a format string straight from the song copy of the query thread,
+ * so that no file has to be written and read again by a text source. The
+ * text is only rasterized again once the formatted string changes,
+ * scrolling just moves the texture */
+class text_source {
+    obs_source_t* m_source = nullptr;
+    gs_texture_t* m_tex = nullptr;
+    uint32_t m_tex_cx = 0, m_tex_cy = 0;
+
+    /* Settings, changed by the UI thread */
+    std::mutex m_mutex;
+    QString m_format {};
+    QFont m_font {};
+    uint32_t m_color {};
+    uint32_t m_cx = 0; /* 0 uses the width of the text */
+    bool m_marquee = false;
+    float m_speed = 50.f;
+    uint32_t m_gap = 50;
+    bool m_dirty = true;
+
+    song m_song {};
+    uint64_t m_version = 0; /* Version of the song copy */
+    bool m_uses_lyrics = false;
+    uint64_t m_lyrics_version = 0;
+    QString m_text {};
+    uint32_t m_width = 0;
+    float m_offset = 0.f;
+
+    void rasterize(uint32_t color);
+
+public:
+    text_source(obs_source_t* src, obs_data_t* settings);
+    ~text_source();
+
+    inline void update(obs_data_t* settings);
+    inline void tick(float seconds);
+    inline void render(gs_effect_t* effect);
+
+    uint32_t get_width() const { return m_width; }
+    uint32_t get_height() const { return m_tex_cy; }
+};
+
+extern void register_text();
+}
@@ -20,12 +20,15 @@
 #include "gui/tuna_gui.hpp"
 #include "gui/widgets/lastfm.hpp"
 #include "query/vlc_obs_source.hpp"
+#include "source/cover.hpp"
 #include "source/progress.hpp"
+#include "source/text.hpp"
 #include "util/config.hpp"
 #include "util/constants.hpp"
 #include "util/format.hpp"
 #include "util/tuna_thread.hpp"
 #include "util/utility.hpp"
+#include "util/window/window_helper.hpp"
 #include <QAction>
 #include <QMainWindow>
 #include <obs-frontend-api.h>
@@ -104,6 +107,8 @@ bool obs_module_load()
     config::load();
     format::init();
     obs_sources::register_progress();
+    obs_sources::register_text();
+    obs_sources::register_cover();
     obs_frontend_add_save_callback(&tuna_save_cb, nullptr);
 
     obs_frontend_add_event_callback([](enum obs_frontend_event event, void*) {
@@ -151,5 +156,6 @@ void obs_module_post_load()
 void obs_module_unload()
 {
     bdebug("Shutting down...");
+    StopWindowTracking();
     config::close();
 }
@@ -19,6 +19,8 @@
 #include "config.hpp"
 #include "../query/music_source.hpp"
 #include "constants.hpp"
+#include "cover_pipeline.hpp"
+#include "lyrics_handler.hpp"
 #include "tuna_thread.hpp"
 #include "utility.hpp"
 #include "web_server.hpp"
@@ -26,6 +28,7 @@
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QStringList>
 #include <obs-frontend-api.h>
 #include <obs-module.h>
 #include <tuple>
@@ -44,6 +47,8 @@ uint16_t cover_size = 256;
 QString placeholder = {};
 QString cover_path = {};
 QString lyrics_path = {};
+QString lyrics_line_path = {};
+QString lyrics_provider = {};
 QString cover_placeholder = {};
 QString selected_source = {};
 bool webserver_enabled = false;
@@ -51,7 +56,11 @@ bool download_cover = true;
 bool download_lyrics = false;
 bool download_missing_cover = true;
 bool placeholder_when_paused = true;
+bool normalize_cover = false;
+bool blur_cover = false;
+bool write_cover = true;
 bool remove_file_extensions = true;
+QList<int> cover_variants = { 64, 300, 0 };
 
 void init()
 {
@@ -63,10 +72,14 @@ void init()
     QString path_song_file = QDir::toNativeSeparators(home.absoluteFilePath("song.txt"));
     QString path_cover_art = QDir::toNativeSeparators(home.absoluteFilePath("cover.png"));
     QString path_lyrics = QDir::toNativeSeparators(home.absoluteFilePath("lyrics.txt"));
+    QString path_lyrics_line = QDir::toNativeSeparators(home.absoluteFilePath("lyrics_line.txt"));
 
     CDEF_STR(CFG_SONG_PATH, qt_to_utf8(path_song_file));
     CDEF_STR(CFG_COVER_PATH, qt_to_utf8(path_cover_art));
     CDEF_STR(CFG_LYRICS_PATH, qt_to_utf8(path_lyrics));
+    CDEF_STR(CFG_LYRICS_LINE_PATH, qt_to_utf8(path_lyrics_line));
+    /* Empty because every song would be sent to a third party */
+    CDEF_STR(CFG_LYRICS_PROVIDER, "");
     CDEF_STR(CFG_SELECTED_SOURCE, S_SOURCE_SPOTIFY);
     CDEF_STR(CFG_SPOTIFY_CLIENT_ID, "847d7cf0c5dc4ff185161d1f000a9d0e");
 
@@ -77,6 +90,9 @@ void init()
     CDEF_BOOL(CFG_DOWNLOAD_COVER, config::download_cover);
     CDEF_BOOL(CFG_DOWNLOAD_MISSING_COVER, config::download_missing_cover);
     CDEF_UINT(CFG_COVER_SIZE, config::cover_size);
+    CDEF_BOOL(CFG_COVER_NORMALIZE, config::normalize_cover);
+    CDEF_BOOL(CFG_COVER_BLUR, config::blur_cover);
+    CDEF_BOOL(CFG_COVER_WRITE, config::write_cover);
     CDEF_UINT(CFG_REFRESH_RATE, config::refresh_rate);
     CDEF_UINT(CFG_SERVER_PORT, config::webserver_port);
     CDEF_STR(CFG_SONG_PLACEHOLDER, T_PLACEHOLDER);
@@ -85,6 +101,7 @@ void init()
     CDEF_BOOL(CFG_DOCK_INFO_VISIBLE, true);
     CDEF_BOOL(CFG_DOCK_VOLUME_VISIBLE, true);
     CDEF_BOOL(CFG_SERVER_ENABLED, false);
+    CDEF_STR(CFG_SERVER_COVER_SIZES, qt_to_utf8(cover_variants_to_string()));
 
     auto tmp = obs_module_file("placeholder.png");
     cover_placeholder = tmp;
@@ -100,6 +117,8 @@ void load()
     load_outputs();
     cover_path = CGET_STR(CFG_COVER_PATH);
     lyrics_path = CGET_STR(CFG_LYRICS_PATH);
+    lyrics_line_path = CGET_STR(CFG_LYRICS_LINE_PATH);
+    lyrics_provider = CGET_STR(CFG_LYRICS_PROVIDER);
     refresh_rate = CGET_UINT(CFG_REFRESH_RATE);
     placeholder = CGET_STR(CFG_SONG_PLACEHOLDER);
     download_lyrics = CGET_BOOL(CFG_DOWNLOAD_LYRICS);
@@ -109,8 +128,13 @@ void load()
     remove_file_extensions = CGET_BOOL(CFG_REMOVE_EXTENSIONS);
     webserver_enabled = CGET_BOOL(CFG_SERVER_ENABLED);
     webserver_port = CGET_UINT(CFG_SERVER_PORT);
+    cover_variants = parse_cover_variants(utf8_to_qt(CGET_STR(CFG_SERVER_COVER_SIZES)));
     selected_source = CGET_STR(CFG_SELECTED_SOURCE);
     cover_size = CGET_UINT(CFG_COVER_SIZE);
+    normalize_cover = CGET_BOOL(CFG_COVER_NORMALIZE);
+    blur_cover = CGET_BOOL(CFG_COVER_BLUR);
+    write_cover = CGET_BOOL(CFG_COVER_WRITE);
+    cover_pipeline::forget_placeholder();
     music_sources::load();
     tuna_thread::thread_mutex.unlock();
 
@@ -120,6 +144,12 @@ void load()
     else if (!run)
         tuna_thread::stop();
 
+    /* The current line is only written while lyrics are enabled */
+    if (tuna_thread::thread_flag && download_lyrics)
+        lyrics::start();
+    else
+        lyrics::stop();
+
     if (webserver_enabled && !web_thread::start())
         berr("Couldn't start web server thread");
     else if (!webserver_enabled)
@@ -134,6 +164,8 @@ void save()
     tuna_thread::thread_mutex.lock();
     CSET_STR(CFG_COVER_PATH, qt_to_utf8(cover_path));
     CSET_STR(CFG_LYRICS_PATH, qt_to_utf8(lyrics_path));
+    CSET_STR(CFG_LYRICS_LINE_PATH, qt_to_utf8(lyrics_line_path));
+    CSET_STR(CFG_LYRICS_PROVIDER, qt_to_utf8(lyrics_provider));
     CSET_UINT(CFG_REFRESH_RATE, refresh_rate);
     CSET_STR(CFG_SONG_PLACEHOLDER, qt_to_utf8(placeholder));
     CSET_BOOL(CFG_DOWNLOAD_LYRICS, download_lyrics);
@@ -143,13 +175,37 @@ void save()
     CSET_BOOL(CFG_REMOVE_EXTENSIONS, remove_file_extensions);
     CSET_BOOL(CFG_SERVER_ENABLED, webserver_enabled);
     CSET_UINT(CFG_SERVER_PORT, webserver_port);
+    CSET_STR(CFG_SERVER_COVER_SIZES, qt_to_utf8(cover_variants_to_string()));
     CSET_STR(CFG_SELECTED_SOURCE, qt_to_utf8(selected_source));
     CSET_UINT(CFG_COVER_SIZE, cover_size);
+    CSET_BOOL(CFG_COVER_NORMALIZE, normalize_cover);
+    CSET_BOOL(CFG_COVER_BLUR, blur_cover);
+    CSET_BOOL(CFG_COVER_WRITE, write_cover);
     save_outputs();
     tuna_thread::thread_mutex.unlock();
     bdebug("Saved config.");
 }
 
+QList<int> parse_cover_variants(const QString& str)
+{
+    QList<int> result;
+    for (const auto& part : str.split(';', Qt::SkipEmptyParts)) {
+        bool ok = false;
+        int size = part.trimmed().toInt(&ok);
+        if (ok && size >= 0 && size <= LARGEST_COVER && !result.contains(size))
+            result.append(size);
+    }
+    return result;
+}
+
+QString cover_variants_to_string()
+{
+    QStringList parts;
+    for (auto size : std::as_const(cover_variants))
+        parts.append(QString::number(size));
+    return parts.join(';');
+}
+
 void load_outputs()
 {
     auto legacy_convert = [](const QString& old) -> QString {
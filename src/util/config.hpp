@@ -44,12 +44,15 @@
 
 #define CFG_SERVER_PORT                 "server_port"
 #define CFG_SERVER_ENABLED              "server_enabled"
+#define CFG_SERVER_COVER_SIZES          "server_cover_sizes"
 
 #define CFG_RUNNING                     "running"
 #define CFG_SONG_PATH                   "song_path"
 #define CFG_COVER_PATH                  "cover_path"
 #define CFG_PLACEHOLDER_WHEN_PAUSED     "placeholder_when_paused"
 #define CFG_LYRICS_PATH                 "lyrics_path"
+#define CFG_LYRICS_LINE_PATH            "lyrics_line_path"
+#define CFG_LYRICS_PROVIDER             "lyrics_provider"
 #define CFG_SELECTED_SOURCE             "music.source"
 #define CFG_REFRESH_RATE                "refresh_rate"
 #define CFG_SONG_FORMAT                 "song_format"
@@ -58,6 +61,9 @@
 #define CFG_DOWNLOAD_COVER              "download_cover"
 #define CFG_DOWNLOAD_MISSING_COVER      "download_missing_cover"
 #define CFG_COVER_SIZE                  "cover_size"
+#define CFG_COVER_NORMALIZE             "cover_normalize"
+#define CFG_COVER_BLUR                  "cover_blur"
+#define CFG_COVER_WRITE                 "cover_write"
 #define CFG_REMOVE_EXTENSIONS           "removeextensions"
 
 #define CFG_SPOTIFY_LOGGEDIN            "spotify.login"
@@ -79,6 +85,7 @@
 #define CFG_MPD_PORT                    "mpd.port"
 #define CFG_MPD_LOCAL                   "mpd.local"
 #define CFG_MPD_BASE_FOLDER             "mpd.base.folder"
+#define CFG_MPD_COVER_NAMES             "mpd.cover.names"
 
 #define CFG_LASTFM_USERNAME             "lastfm.username"
 #define CFG_LASTFM_API_KEY              "lastfm.apikey"
@@ -88,6 +95,11 @@
 #define CFG_MPRIS_PLAYER                "mpris.player"
 
 #define CFG_ICECAST_URL                 "icecast.url"
+#define CFG_ICECAST_MOUNT               "icecast.mount"
+#define CFG_ICECAST_USE_ICY             "icecast.use_icy"
+
+#define CFG_AUTO_SOURCES                "auto.sources"
+#define CFG_AUTO_SWITCH_DELAY           "auto.switch_delay"
 
 #define CFG_WINDOW_TITLE                "window.title"
 #define CFG_WINDOW_PAUSE                "window.title.pause"
@@ -112,6 +124,7 @@ struct output {
     QString path;
     QString last_output;
     bool log_mode;
+    uint64_t last_identity = 0; /* Last song that was appended in log mode */
 };
 
 extern config_t* instance;
@@ -125,6 +138,8 @@ extern QString selected_source;
 extern QString placeholder;
 extern QString cover_path;
 extern QString lyrics_path;
+extern QString lyrics_line_path;
+extern QString lyrics_provider;
 extern QString cover_placeholder;
 
 extern QList<output> outputs;
@@ -134,7 +149,15 @@ extern bool download_lyrics;
 extern bool download_missing_cover;
 extern bool remove_file_extensions;
 extern bool placeholder_when_paused;
+extern bool normalize_cover;
+extern bool blur_cover;
+extern bool write_cover;
 extern uint16_t cover_size;
+extern QList<int> cover_variants;
+
+/* Parses a list like "64;300;0" into cover sizes, zero means unscaled */
+QList<int> parse_cover_variants(const QString& str);
+QString cover_variants_to_string();
 
 void init();
 
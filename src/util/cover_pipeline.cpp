@@ -0,0 +1,480 @@
+/*************************************************************************
+ * This file is part of tuna
+ * git.vrsal.xyz/alex/tuna
+ * Copyright 2023 univrsal <uni@vrsal.xyz>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#include "cover_pipeline.hpp"
+#include "config.hpp"
+#include "constants.hpp"
+#include "utility.hpp"
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QMap>
+#include <QSaveFile>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <mutex>
+#include <vector>
+
+namespace cover_pipeline {
+
+static std::mutex mutex;
+static QImage current_image;
+static QByteArray current_data;
+static uint64_t current_revision = 0;
+static uint64_t current_identity = 0;
+static QMap<int, variant> variants; /* 0 is stored as INT_MAX to keep it last */
+static palette current_colors;
+static variant blurred;
+static variant original;
+
+static QImage normalize(const QImage& image)
+{
+    /* Premultiplied 32 bit is what Qt's smooth scaling is optimized for */
+    auto result = image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32);
+
+    /* Covers are only ever scaled down */
+    int size = config::cover_size;
+    if (size < LARGEST_COVER && (result.width() > size || result.height() > size))
+        result = result.scaled(size, size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    return result;
+}
+
+static inline bool use_jpeg()
+{
+    auto suffix = QFileInfo(config::cover_path).suffix().toLower();
+    return suffix == "jpg" || suffix == "jpeg";
+}
+
+static QByteArray encode(const QImage& image)
+{
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+
+    if (use_jpeg())
+        image.save(&buffer, "JPG", 90);
+    else
+        image.save(&buffer, "PNG");
+    return data;
+}
+
+static const char* sniff_mime(const QByteArray& data)
+{
+    if (data.startsWith("\xFF\xD8\xFF"))
+        return "image/jpeg";
+    if (data.startsWith("\x89PNG"))
+        return "image/png";
+    if (data.startsWith("GIF8"))
+        return "image/gif";
+    if (data.startsWith("RIFF") && data.mid(8, 4) == "WEBP")
+        return "image/webp";
+    return "application/octet-stream";
+}
+
+static QMap<int, variant> create_variants(const QImage& image, const QByteArray& data)
+{
+    QMap<int, variant> result;
+    if (image.isNull() || !config::webserver_enabled)
+        return result;
+
+    auto* mime = use_jpeg() ? "image/jpeg" : "image/png";
+    auto scaled = image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32);
+    for (auto size : std::as_const(config::cover_variants)) {
+        variant v;
+        if (size <= 0 || (image.width() <= size && image.height() <= size)) {
+            /* Covers that are already small enough are served as written */
+            v.data = data;
+            v.mime = sniff_mime(data);
+            size = size <= 0 ? INT_MAX : size;
+        } else {
+            v.data = encode(scaled.scaled(size, size, Qt::KeepAspectRatio, Qt::SmoothTransformation));
+            v.mime = mime;
+        }
+        v.etag = '"' + QCryptographicHash::hash(v.data, QCryptographicHash::Md5).toHex().toStdString() + '"';
+        result[size] = v;
+    }
+    return result;
+}
+
+static palette create_palette(const QImage& image)
+{
+    palette result;
+    if (image.isNull())
+        return result;
+
+    /* 64x64 pixels are plenty for a handful of colors */
+    auto small = image.scaled(64, 64, Qt::KeepAspectRatio, Qt::FastTransformation).convertToFormat(QImage::Format_ARGB32);
+
+    /* Histogram over colors quantized to four bits per channel, the sums are
+     * used to get the average color of each bucket */
+    struct bucket {
+        uint32_t count, r, g, b;
+    };
+    std::vector<bucket> buckets(4096, { 0, 0, 0, 0 });
+    uint32_t total = 0;
+
+    for (int y = 0; y < small.height(); y++) {
+        auto const* line = reinterpret_cast<const QRgb*>(small.constScanLine(y));
+        for (int x = 0; x < small.width(); x++) {
+            auto px = line[x];
+            if (qAlpha(px) < 128)
+                continue;
+            auto r = uint32_t(qRed(px)), g = uint32_t(qGreen(px)), b = uint32_t(qBlue(px));
+            auto& bk = buckets[((r >> 4) << 8) | ((g >> 4) << 4) | (b >> 4)];
+            bk.count++;
+            bk.r += r;
+            bk.g += g;
+            bk.b += b;
+            total++;
+        }
+    }
+
+    if (total == 0)
+        return result;
+
+    float best_dominant = 0, best_vibrant = 0, best_muted = 0;
+    for (auto const& bk : buckets) {
+        if (bk.count == 0)
+            continue;
+        QColor c(bk.r / bk.count, bk.g / bk.count, bk.b / bk.count);
+        float weight = std::sqrt(float(bk.count) / total);
+        float s = c.hslSaturationF(), l = c.lightnessF();
+
+        if (bk.count > best_dominant) {
+            best_dominant = bk.count;
+            result.dominant = c;
+        }
+
+        /* Saturated colors that are neither close to black nor white */
+        float vibrant = s * s * (1.f - std::abs(l - .5f) * 2.f) * weight;
+        if (vibrant > best_vibrant) {
+            best_vibrant = vibrant;
+            result.vibrant = c;
+        }
+
+        /* Desaturated mid tones */
+        float muted = (s < .5f ? 1.f - std::abs(s - .25f) * 4.f : 0.f) * (1.f - std::abs(l - .45f) * 2.f) * weight;
+        if (muted > best_muted) {
+            best_muted = muted;
+            result.muted = c;
+        }
+    }
+
+    if (!result.vibrant.isValid())
+        result.vibrant = result.dominant;
+    if (!result.muted.isValid())
+        result.muted = result.dominant;
+    return result;
+}
+
+/* One pass of a box blur over a row or column of 32 bit pixels, step is the
+ * distance between two pixels in bytes. Edges are clamped */
+static void box_blur_line(const uchar* src, uchar* dst, int count, int step, int radius)
+{
+    int window = radius * 2 + 1;
+    auto at = [&](int i, int c) { return int(src[std::clamp(i, 0, count - 1) * step + c]); };
+
+    for (int c = 0; c < 4; c++) {
+        int sum = 0;
+        for (int i = -radius; i <= radius; i++)
+            sum += at(i, c);
+        for (int i = 0; i < count; i++) {
+            dst[i * step + c] = uchar(sum / window);
+            sum += at(i + radius + 1, c) - at(i - radius, c);
+        }
+    }
+}
+
+static QImage create_blurred(const QImage& image)
+{
+    if (image.isNull())
+        return {};
+
+    /* The result is blurry anyway, so it's fine to work on a small copy and
+     * let whatever displays it scale it up */
+    auto result = image.scaled(160, 160, Qt::KeepAspectRatio, Qt::SmoothTransformation)
+                      .convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    QImage tmp(result.size(), result.format());
+    int w = result.width(), h = result.height();
+    int radius = std::max(std::max(w, h) / 20, 1);
+
+    /* Three box blurs in a row are close enough to a gaussian blur */
+    for (int pass = 0; pass < 3; pass++) {
+        for (int y = 0; y < h; y++)
+            box_blur_line(result.constScanLine(y), tmp.scanLine(y), w, 4, radius);
+        for (int x = 0; x < w; x++)
+            box_blur_line(tmp.constBits() + x * 4, result.bits() + x * 4, h, int(result.bytesPerLine()), radius);
+    }
+
+    /* Darken it so that text on top stays readable */
+    for (int y = 0; y < h; y++) {
+        auto* line = reinterpret_cast<QRgb*>(result.scanLine(y));
+        for (int x = 0; x < w; x++) {
+            auto px = line[x];
+            line[x] = qRgba(qRed(px) * 5 / 8, qGreen(px) * 5 / 8, qBlue(px) * 5 / 8, qAlpha(px));
+        }
+    }
+    return result;
+}
+
+static bool write(const QString& path, const QByteArray& data)
+{
+    /* Written to a temporary file first, so that nothing reads a half
+     * written cover */
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        berr("Failed to open cover file '%s' for writing", qt_to_utf8(path));
+        return false;
+    }
+
+    if (file.write(data) != data.size() || !file.commit()) {
+        berr("Failed to write cover to '%s'", qt_to_utf8(path));
+        file.cancelWriting();
+        return false;
+    }
+    return true;
+}
+
+/* Everything that is derived from one cover */
+struct processed {
+    QImage image;
+    QByteArray data;
+    QMap<int, variant> variants;
+    palette colors;
+    variant blurred;
+    variant original;
+};
+
+/* The placeholder only changes with the config, so it's only processed once
+ * per config load */
+static processed placeholder;
+static bool placeholder_ready = false;
+static bool placeholder_current = false;
+
+static processed process(const QImage& image, const QByteArray& original)
+{
+    processed p {};
+    p.image = image;
+    p.data = original;
+
+    if (config::normalize_cover && !image.isNull()) {
+        p.image = normalize(image);
+        p.data = encode(p.image);
+    } else if (p.data.isEmpty()) {
+        p.data = encode(p.image);
+    }
+
+    if (!p.data.isEmpty()) {
+        p.original.data = p.data;
+        p.original.mime = sniff_mime(p.data);
+        p.original.etag = '"' + QCryptographicHash::hash(p.data, QCryptographicHash::Md5).toHex().toStdString() + '"';
+    }
+
+    p.variants = create_variants(p.image, p.data);
+    p.colors = create_palette(p.image);
+
+    if (config::blur_cover) {
+        p.blurred.data = encode(create_blurred(p.image));
+        p.blurred.mime = use_jpeg() ? "image/jpeg" : "image/png";
+        p.blurred.etag = '"' + QCryptographicHash::hash(p.blurred.data, QCryptographicHash::Md5).toHex().toStdString() + '"';
+    }
+    return p;
+}
+
+static bool publish(const processed& p, bool is_placeholder)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        current_image = p.image;
+        current_data = p.data;
+        current_revision++;
+        current_identity = p.data.isEmpty() ? 0 : qHash(p.data) | 1;
+        variants = p.variants;
+        current_colors = p.colors;
+        blurred = p.blurred;
+        original = p.original;
+        placeholder_current = is_placeholder;
+    }
+
+    /* The cover source gets the image from memory, so the files are optional */
+    if (!config::write_cover)
+        return true;
+    if (!p.blurred.data.isEmpty())
+        write(blur_path(), p.blurred.data);
+    return write(config::cover_path, p.data);
+}
+
+static bool store(const QImage& image, const QByteArray& original)
+{
+    return publish(process(image, original), false);
+}
+
+static bool decode(const QByteArray& data, QImage& image)
+{
+    /* Without normalization images that Qt can't decode are still written
+     * as they are, OBS might still be able to read them */
+    if (!image.loadFromData(data)) {
+        berr("Failed to decode cover image (%i bytes)", int(data.size()));
+        if (config::normalize_cover)
+            return false;
+    }
+    return true;
+}
+
+static bool read_file(const QString& path, QByteArray& data)
+{
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly)) {
+        berr("Failed to open cover file '%s'", qt_to_utf8(path));
+        return false;
+    }
+    data = f.readAll();
+    return true;
+}
+
+bool submit(const QByteArray& data)
+{
+    QImage image;
+    if (data.isEmpty() || !decode(data, image))
+        return false;
+    return store(image, data);
+}
+
+bool submit(const QImage& image)
+{
+    if (image.isNull())
+        return false;
+    return store(image, {});
+}
+
+bool submit_file(const QString& path)
+{
+    QByteArray data;
+    return read_file(path, data) && submit(data);
+}
+
+bool submit_placeholder()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if (placeholder_current)
+        return true;
+
+    if (!placeholder_ready) {
+        lock.unlock();
+        processed p {};
+        QByteArray data;
+        QImage image;
+        if (read_file(config::cover_placeholder, data) && !data.isEmpty() && decode(data, image)) {
+            p = process(image, data);
+            /* The colors of the placeholder aren't cover colors */
+            p.colors = {};
+        }
+        lock.lock();
+
+        /* Failures are remembered as well, the file won't get any better
+         * until the config is loaded again */
+        placeholder = p;
+        placeholder_ready = true;
+    }
+
+    if (placeholder.data.isEmpty())
+        return false;
+    auto p = placeholder;
+    lock.unlock();
+    return publish(p, true);
+}
+
+void forget_placeholder()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    placeholder = {};
+    placeholder_ready = false;
+    placeholder_current = false;
+}
+
+uint64_t revision()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return current_revision;
+}
+
+bool get_variant(int size, variant& out)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    /* The web server might have been enabled after the cover was submitted */
+    if (variants.isEmpty())
+        variants = create_variants(current_image, current_data);
+    if (variants.isEmpty())
+        return false;
+
+    auto it = variants.lowerBound(size <= 0 ? INT_MAX : size);
+    out = it == variants.end() ? variants.last() : it.value();
+    return true;
+}
+
+bool get_original(variant& out)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (original.data.isEmpty())
+        return false;
+    out = original;
+    return true;
+}
+
+bool get_blurred(variant& out)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (blurred.data.isEmpty())
+        return false;
+    out = blurred;
+    return true;
+}
+
+QString blur_path()
+{
+    QFileInfo info(config::cover_path);
+    return info.dir().filePath(info.completeBaseName() + "_blur." + info.suffix());
+}
+
+palette current_palette()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return current_colors;
+}
+
+QImage current(uint64_t* revision, uint64_t* identity)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (revision)
+        *revision = current_revision;
+    if (identity)
+        *identity = current_identity;
+    return current_image;
+}
+
+uint64_t identity()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return current_identity;
+}
+}
@@ -0,0 +1,93 @@
+/*************************************************************************
+ * This file is part of tuna
+ * git.vrsal.xyz/alex/tuna
+ * Copyright 2023 univrsal <uni@vrsal.xyz>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#pragma once
+#include <QByteArray>
+#include <QColor>
+#include <QImage>
+#include <QString>
+#include <stdint.h>
+#include <string>
+
+/* Every cover goes through here before it's written to the cover path.
+ * The image is decoded once and, if enabled, scaled down to the configured
+ * cover size and encoded in the format of the cover path, so consumers
+ * always get a small file of a known format. The decoded image is kept
+ * for the cover source, which makes writing the file optional */
+namespace cover_pipeline {
+
+/* Encoded image data, e.g. from a download or from tags */
+extern bool submit(const QByteArray& data);
+
+extern bool submit(const QImage& image);
+
+extern bool submit_file(const QString& path);
+
+/* Shows config::cover_placeholder, which is only processed once per config
+ * load and not submitted again while it's still the current cover */
+extern bool submit_placeholder();
+
+/* Called when the config is loaded, since it changes how the placeholder
+ * is processed */
+extern void forget_placeholder();
+
+/* Revision of the current cover, changes every time a cover is submitted */
+extern uint64_t revision();
+
+/* Hash of the current cover data, unlike the revision it stays the same if
+ * the same cover is submitted again. Zero if there is no cover */
+extern uint64_t identity();
+
+/* Decoded (and normalized) current cover, its revision and identity */
+extern QImage current(uint64_t* revision = nullptr, uint64_t* identity = nullptr);
+
+/* Encoded copies of the current cover in the sizes from config::cover_variants,
+ * generated once per cover if the web server is enabled. Size zero is the
+ * unscaled cover */
+struct variant {
+    QByteArray data;
+    std::string etag;
+    const char* mime;
+};
+
+/* Gets the smallest variant that is at least as large as the requested
+ * size, or the largest one if none is */
+extern bool get_variant(int size, variant& out);
+
+/* The current cover as it would be written to the cover path */
+extern bool get_original(variant& out);
+
+/* Small palette of the current cover, computed once per cover. It's
+ * invalid while the placeholder is shown */
+struct palette {
+    QColor dominant;
+    QColor vibrant;
+    QColor muted;
+
+    bool valid() const { return dominant.isValid(); }
+};
+
+extern palette current_palette();
+
+/* Blurred and darkened copy of the current cover for backgrounds, only
+ * created if config::blur_cover is set. It's written to blur_path() and
+ * kept in memory for the web server */
+extern bool get_blurred(variant& out);
+
+extern QString blur_path();
+}
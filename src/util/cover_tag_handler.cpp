@@ -24,17 +24,22 @@
 #include "cover_tag_handler.hpp"
 #include "../query/song.hpp"
 #include "config.hpp"
+#include "cover_pipeline.hpp"
+#include "tag_file.hpp"
 #include "utility.hpp"
 #include <QDir>
-#include <QDirIterator>
 #include <QFile>
 #include <QFileInfo>
+#include <QHash>
+#include <QRegularExpression>
+#include <QSet>
+#include <memory>
+#include <mutex>
 #include <taglib/apefile.h>
 #include <taglib/apeitem.h>
 #include <taglib/apetag.h>
 #include <taglib/asffile.h>
 #include <taglib/attachedpictureframe.h>
-#include <taglib/fileref.h>
 #include <taglib/flacfile.h>
 #include <taglib/id3v2frame.h>
 #include <taglib/id3v2tag.h>
@@ -45,51 +50,57 @@
 #include <taglib/tlist.h>
 #include <taglib/tmap.h>
 
+#ifdef __linux__
+#    include <sys/inotify.h>
+#    include <unistd.h>
+#endif
+
 namespace cover {
 
-bool write_bytes_to_file(const TagLib::ByteVector& data)
-{
-    if (data.isEmpty())
-        return false;
-    QFile f(config::cover_path);
-    bool success = true;
-    if (f.open(QIODevice::WriteOnly)) {
-        success = f.write(data.data(), data.size()) == data.size();
-        f.close();
-    } else {
-        success = false;
-    }
+/* Pictures are shared between all files that contain the same one, which
+ * is usually every file of an album. Cache size is limited by the number of
+ * files and the total size of all distinct pictures */
+#define MAX_CACHED_FILES 512
+#define MAX_CACHED_BYTES (64 * 1024 * 1024)
 
-    return success;
-}
+typedef std::shared_ptr<const QByteArray> picture_ptr;
+
+struct cached_file {
+    util::file_identity id;
+    picture_ptr picture; /* null if the file has no embedded picture */
+    uint64_t last_use;
+};
 
-bool extract_ape(TagLib::APE::Tag* tag)
+static std::mutex cache_mutex;
+static QHash<QString, cached_file> file_cache;
+static QHash<QString, std::weak_ptr<const QByteArray>> album_cache;
+static uint64_t use_counter = 0;
+
+TagLib::ByteVector extract_ape(TagLib::APE::Tag* tag)
 {
     const TagLib::APE::ItemListMap& listMap = tag->itemListMap();
     if (listMap.contains("COVER ART (FRONT)")) {
         const TagLib::ByteVector nullStringTerminator(1, 0);
         TagLib::ByteVector item = listMap["COVER ART (FRONT)"].value();
         const int pos = item.find(nullStringTerminator); // Skip the filename.
-        if (pos != -1) {
-            const TagLib::ByteVector& pic = item.mid(pos + 1);
-            return write_bytes_to_file(pic);
-        }
+        if (pos != -1)
+            return item.mid(pos + 1);
     }
 
-    return false;
+    return {};
 }
 
-bool extract_id3(TagLib::ID3v2::Tag* tag)
+TagLib::ByteVector extract_id3(TagLib::ID3v2::Tag* tag)
 {
     const TagLib::ID3v2::FrameList& frameList = tag->frameList("APIC");
     if (!frameList.isEmpty()) {
         const auto* frame = (TagLib::ID3v2::AttachedPictureFrame*)frameList.front();
-        return write_bytes_to_file(frame->picture());
+        return frame->picture();
     }
-    return false;
+    return {};
 }
 
-bool extract_asf(TagLib::ASF::File* file)
+TagLib::ByteVector extract_asf(TagLib::ASF::File* file)
 {
     const TagLib::ASF::AttributeListMap& attrListMap = file->tag()->attributeListMap();
     if (attrListMap.contains("WM/Picture")) {
@@ -97,134 +108,316 @@ bool extract_asf(TagLib::ASF::File* file)
         if (!attrList.isEmpty()) {
             // Let's grab the first cover. TODO: Check/loop for correct type.
             const TagLib::ASF::Picture& wmpic = attrList[0].toPicture();
-            if (wmpic.isValid()) {
-                return write_bytes_to_file(wmpic.picture());
-            }
+            if (wmpic.isValid())
+                return wmpic.picture();
         }
     }
 
-    return false;
+    return {};
 }
 
-bool extract_flac(TagLib::FLAC::File* file)
+TagLib::ByteVector extract_flac(TagLib::FLAC::File* file)
 {
     const TagLib::List<TagLib::FLAC::Picture*>& picList = file->pictureList();
     if (!picList.isEmpty()) {
         // Just grab the first image.
         const TagLib::FLAC::Picture* pic = picList[0];
-        return write_bytes_to_file(pic->data());
+        return pic->data();
     }
 
-    return false;
+    return {};
 }
 
-bool extract_mp4(TagLib::MP4::File* file)
+TagLib::ByteVector extract_mp4(TagLib::MP4::File* file)
 {
     TagLib::MP4::Tag* tag = file->tag();
     const TagLib::MP4::ItemMap& itemListMap = tag->itemMap();
     if (itemListMap.contains("covr")) {
         const TagLib::MP4::CoverArtList& coverArtList = itemListMap["covr"].toCoverArtList();
-        if (!coverArtList.isEmpty()) {
-            const TagLib::MP4::CoverArt* pic = &(coverArtList.front());
-            return write_bytes_to_file(pic->data());
-        }
+        if (!coverArtList.isEmpty())
+            return coverArtList.front().data();
     }
 
-    return false;
+    return {};
 }
 
-bool extract_opus(TagLib::Ogg::Opus::File* file)
+TagLib::ByteVector extract_opus(TagLib::Ogg::Opus::File* file)
 {
     auto* tag = file->tag();
     auto pictures = tag->pictureList();
     if (!pictures.isEmpty()) {
         /* I'll just assume that the last image is the one with the biggest size */
-        return write_bytes_to_file(pictures[pictures.size() - 1]->data());
+        return pictures[pictures.size() - 1]->data();
     }
-    return false;
+    return {};
 }
 
-bool get_embedded(TagLib::FileRef fr)
+QByteArray read_embedded_picture(TagLib::File* file)
 {
-    bool found = false;
+    TagLib::ByteVector found;
 
-    if (TagLib::MPEG::File* mpeg = dynamic_cast<TagLib::MPEG::File*>(fr.file())) {
+    if (TagLib::MPEG::File* mpeg = dynamic_cast<TagLib::MPEG::File*>(file)) {
         if (mpeg->hasID3v2Tag()) {
             found = extract_id3(mpeg->ID3v2Tag());
         } else if (mpeg->hasAPETag()) {
             found = extract_ape(mpeg->APETag());
         }
-    } else if (TagLib::FLAC::File* flac = dynamic_cast<TagLib::FLAC::File*>(fr.file())) {
+    } else if (TagLib::FLAC::File* flac = dynamic_cast<TagLib::FLAC::File*>(file)) {
         found = extract_flac(flac);
-        if (!found && flac->ID3v2Tag())
+        if (found.isEmpty() && flac->ID3v2Tag())
             found = extract_id3(flac->ID3v2Tag());
-    } else if (TagLib::MP4::File* mp4 = dynamic_cast<TagLib::MP4::File*>(fr.file())) {
+    } else if (TagLib::MP4::File* mp4 = dynamic_cast<TagLib::MP4::File*>(file)) {
         found = extract_mp4(mp4);
-    } else if (TagLib::ASF::File* asf = dynamic_cast<TagLib::ASF::File*>(fr.file())) {
+    } else if (TagLib::ASF::File* asf = dynamic_cast<TagLib::ASF::File*>(file)) {
         found = extract_asf(asf);
-    } else if (TagLib::APE::File* ape = dynamic_cast<TagLib::APE::File*>(fr.file())) {
+    } else if (TagLib::APE::File* ape = dynamic_cast<TagLib::APE::File*>(file)) {
         if (ape->APETag())
             found = extract_ape(ape->APETag());
-    } else if (TagLib::MPC::File* mpc = dynamic_cast<TagLib::MPC::File*>(fr.file())) {
+    } else if (TagLib::MPC::File* mpc = dynamic_cast<TagLib::MPC::File*>(file)) {
         if (mpc->APETag())
             found = extract_ape(mpc->APETag());
-    } else if (TagLib::Ogg::Opus::File* ogg = dynamic_cast<TagLib::Ogg::Opus::File*>(fr.file())) {
+    } else if (TagLib::Ogg::Opus::File* ogg = dynamic_cast<TagLib::Ogg::Opus::File*>(file)) {
         if (ogg->tag())
             found = extract_opus(ogg);
     }
 
-    return found;
+    return QByteArray(found.data(), int(found.size()));
+}
+
+/* Requires the cache mutex to be held */
+static void trim_cache()
+{
+    for (;;) {
+        QSet<const QByteArray*> counted;
+        qint64 bytes = 0;
+        auto oldest = file_cache.end();
+        for (auto it = file_cache.begin(); it != file_cache.end(); ++it) {
+            auto* pic = it.value().picture.get();
+            if (pic && !counted.contains(pic)) {
+                counted.insert(pic);
+                bytes += pic->size();
+            }
+            if (oldest == file_cache.end() || it.value().last_use < oldest.value().last_use)
+                oldest = it;
+        }
+
+        if ((file_cache.size() <= MAX_CACHED_FILES && bytes <= MAX_CACHED_BYTES) || oldest == file_cache.end())
+            break;
+        file_cache.erase(oldest);
+    }
+
+    for (auto it = album_cache.begin(); it != album_cache.end();)
+        it = it.value().expired() ? album_cache.erase(it) : std::next(it);
 }
 
-bool find_embedded_cover(const QString& path)
+bool is_embedded_cover_cached(const QString& path, const QString& album)
 {
-    bool result = false;
-#ifdef _WIN32
-    // Windoze can't into utf8
-    const auto wstr = path.toStdWString();
-    const TagLib::FileRef fr(wstr.c_str(), false);
-#else
-    const TagLib::FileRef fr(qt_to_utf8(path), false);
+    util::file_identity id;
+    if (!util::get_file_identity(path, id))
+        return false;
+
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto it = file_cache.find(path);
+    if (it != file_cache.end() && it.value().id == id)
+        return true;
+    return !album.isEmpty() && !album_cache.value(album).expired();
+}
+
+bool find_embedded_cover(tag_file& file, const QString& album)
+{
+    auto const& path = file.path();
+    util::file_identity id;
+    if (!util::get_file_identity(path, id))
+        return false;
+
+    picture_ptr picture;
+    bool cached = false;
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        auto it = file_cache.find(path);
+        if (it != file_cache.end() && it.value().id == id) {
+            it.value().last_use = ++use_counter;
+            picture = it.value().picture;
+            cached = true;
+        } else if (!album.isEmpty()) {
+            /* Files of the same album share their picture, so the other
+             * tracks don't have to be parsed again */
+            picture = album_cache.value(album).lock();
+            if (picture) {
+                file_cache[path] = { id, picture, ++use_counter };
+                cached = true;
+            }
+        }
+    }
+
+    if (!cached) {
+        if (file.read() && !file.picture().isEmpty())
+            picture = std::make_shared<const QByteArray>(file.picture());
+
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        if (picture && !album.isEmpty())
+            album_cache[album] = picture;
+        file_cache[path] = { id, picture, ++use_counter };
+        trim_cache();
+    }
+
+    return picture && cover_pipeline::submit(*picture);
+}
+
+/* Folder covers are looked up once per directory and kept until the
+ * directory changes. The modification time of the directory is checked on
+ * every lookup, since inotify doesn't see changes that were made remotely
+ * on network shares. On linux inotify also reports local changes to the
+ * images themselves, which don't touch the directory */
+#define MAX_INDEXED_FOLDERS 1024
+
+struct folder_entry {
+    QString cover; /* empty if the folder has no images */
+    int64_t mtime;
+    int watch;
+    uint64_t last_use;
+};
+
+static std::mutex folder_mutex;
+static QHash<QString, folder_entry> folder_index;
+static QList<QRegularExpression> cover_names;
+static uint64_t folder_use_counter = 0;
+#ifdef __linux__
+static int inotify_fd = -1;
+static QHash<int, QString> watched_folders;
 #endif
 
-    if (!fr.isNull())
-        result = get_embedded(fr);
-    return result;
+/* Requires the folder mutex to be held */
+static void remove_folder(QHash<QString, folder_entry>::iterator it)
+{
+#ifdef __linux__
+    if (it.value().watch >= 0) {
+        inotify_rm_watch(inotify_fd, it.value().watch);
+        watched_folders.remove(it.value().watch);
+    }
+#endif
+    folder_index.erase(it);
 }
 
-bool find_local_cover(const QString& folder, QString& out)
+/* Requires the folder mutex to be held */
+static void process_folder_events()
+{
+#ifdef __linux__
+    if (inotify_fd < 0)
+        return;
+
+    alignas(struct inotify_event) char buf[4096];
+    ssize_t len;
+    while ((len = read(inotify_fd, buf, sizeof(buf))) > 0) {
+        for (char* ptr = buf; ptr < buf + len;) {
+            auto* event = reinterpret_cast<struct inotify_event*>(ptr);
+            ptr += sizeof(struct inotify_event) + event->len;
+
+            auto folder = watched_folders.value(event->wd);
+            if (event->mask & IN_IGNORED) {
+                /* The kernel removed the watch on its own */
+                watched_folders.remove(event->wd);
+                auto it = folder_index.find(folder);
+                if (it != folder_index.end() && it.value().watch == event->wd)
+                    it.value().watch = -1;
+            }
+
+            auto it = folder_index.find(folder);
+            if (it != folder_index.end())
+                remove_folder(it);
+        }
+    }
+#endif
+}
+
+static int64_t folder_mtime(const QString& folder)
+{
+    util::file_identity id;
+    return util::get_file_identity(folder, id) ? id.mtime : -1;
+}
+
+static QString pick_cover(const QString& folder)
 {
     static QStringList exts = { "*.jpg", "*.jpeg", "*.png", "*.bmp" };
-    QList<QString> OtherFiles;
-    QDirIterator it(folder, exts, QDir::Files, QDirIterator::NoIteratorFlags);
-    while (it.hasNext()) {
-        if (it.next().contains("cover", Qt::CaseInsensitive)) {
-            out = it.filePath();
-            return true;
+    QDir dir(folder);
+    dir.setNameFilters(exts);
+    dir.setFilter(QDir::Files);
+
+    /* Sorted by size, so that the largest image is picked if none of
+     * the names match */
+    dir.setSorting(QDir::Size);
+    auto files = dir.entryInfoList();
+    if (files.isEmpty())
+        return {};
+
+    for (const auto& name : std::as_const(cover_names)) {
+        for (const auto& file : std::as_const(files)) {
+            if (name.match(file.fileName()).hasMatch())
+                return file.filePath();
         }
-        OtherFiles.append(it.filePath());
     }
+    return files.first().filePath();
+}
 
-    /* If we couldn't find a file named cover, we resort to picking the largest
-     * image file in the folder
-     */
-    qint64 biggest_image_size = 0;
-    QString biggest_image = "";
+void set_local_cover_names(const QString& names)
+{
+    std::lock_guard<std::mutex> lock(folder_mutex);
+    cover_names.clear();
+    for (const auto& name : names.split(';', Qt::SkipEmptyParts)) {
+        auto pattern = QRegularExpression::wildcardToRegularExpression(name.trimmed());
+        cover_names.append(QRegularExpression(pattern, QRegularExpression::CaseInsensitiveOption));
+    }
+
+    /* Choices might be different now */
+    while (!folder_index.isEmpty())
+        remove_folder(folder_index.begin());
+}
 
-    for (const auto& file : OtherFiles) {
-        QFileInfo info(file);
-        if (info.size() > biggest_image_size) {
-            biggest_image = file;
-            biggest_image_size = info.size();
+bool find_local_cover(const QString& folder, QString& out)
+{
+    std::lock_guard<std::mutex> lock(folder_mutex);
+    process_folder_events();
+
+    auto it = folder_index.find(folder);
+    if (it != folder_index.end()) {
+        if (it.value().mtime == folder_mtime(folder)) {
+            it.value().last_use = ++folder_use_counter;
+            out = it.value().cover;
+            return !out.isEmpty();
         }
+        remove_folder(it);
     }
 
-    if (!biggest_image.isEmpty()) {
-        out = biggest_image;
-        return true;
+    folder_entry entry { {}, folder_mtime(folder), -1, ++folder_use_counter };
+#ifdef __linux__
+    if (inotify_fd < 0)
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd >= 0) {
+        entry.watch = inotify_add_watch(inotify_fd, qt_to_utf8(folder),
+            IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF);
+        if (entry.watch >= 0) {
+            /* Watch descriptors are reused for the same inode */
+            auto old = folder_index.find(watched_folders.value(entry.watch));
+            if (old != folder_index.end() && old.key() != folder)
+                old.value().watch = -1;
+            watched_folders[entry.watch] = folder;
+        }
+    }
+#endif
+    entry.cover = pick_cover(folder);
+
+    if (folder_index.size() >= MAX_INDEXED_FOLDERS) {
+        auto oldest = folder_index.begin();
+        for (auto i = folder_index.begin(); i != folder_index.end(); ++i) {
+            if (i.value().last_use < oldest.value().last_use)
+                oldest = i;
+        }
+        remove_folder(oldest);
     }
+    folder_index[folder] = entry;
 
-    return false;
+    out = entry.cover;
+    return !out.isEmpty();
 }
 
 void get_file_folder(QString& path)
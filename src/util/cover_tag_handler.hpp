@@ -17,13 +17,33 @@
  *************************************************************************/
 
 #pragma once
+#include <QByteArray>
 #include <QString>
 
+class tag_file;
+
+namespace TagLib {
+class File;
+}
+
 namespace cover {
-/* Tries to get the song embbeded in the file */
-extern bool find_embedded_cover(const QString& path);
+/* Tries to get the song embbeded in the file, results are cached per file
+ * version. Files with the same (optional) album key share one picture, so
+ * only the first file of an album is parsed */
+extern bool find_embedded_cover(tag_file& file, const QString& album = {});
+
+/* True if find_embedded_cover() won't have to parse the file */
+extern bool is_embedded_cover_cached(const QString& path, const QString& album = {});
+
+/* Front cover from whichever tag the file format uses */
+extern QByteArray read_embedded_picture(TagLib::File* file);
+
+/* Semicolon separated list of file name patterns (e.g. "folder.*;front.*")
+ * that are preferred for folder covers, in order of priority */
+extern void set_local_cover_names(const QString& names);
 
-/* Tries to find the cover in the folder that the file is located in */
+/* Tries to find the cover in the folder that the file is located in, if no
+ * file name matches the largest image is used */
 extern bool find_local_cover(const QString& path, QString& cover_out);
 
 /* Turns /home/usr/file.flac into /home/usr/ */
@@ -19,7 +19,11 @@
 #include "format.hpp"
 #include "../query/music_source.hpp"
 #include "../query/song.hpp"
+#include "../query/vlc_obs_source.hpp"
 #include "../util/config.hpp"
+#include "../util/constants.hpp"
+#include "../util/cover_pipeline.hpp"
+#include "../util/lyrics_handler.hpp"
 #include "../util/tuna_thread.hpp"
 #include <QJsonDocument>
 #include <QLocale>
@@ -58,10 +62,7 @@ void init()
 
     /* Register format specifiers with their data */
     specifiers.emplace_back(new specifier("title", meta::TITLE, [](song const& s) -> QString {
-        auto title = s.get(meta::TITLE);
-        if (config::remove_file_extensions)
-            title = util::remove_extensions(title);
-        return title;
+        return s.derived()->title;
     }));
     specifiers.emplace_back(new specifier("album", meta::ALBUM));
     specifiers.emplace_back(new specifier("label", meta::LABEL));
@@ -75,30 +76,17 @@ void init()
     int_specifier("disc_number", meta::DISC_NUMBER);
 
     specifiers.emplace_back(new specifier("progress", meta::PROGRESS, [](song const& s) -> QString {
-        return time_format(s.get<int>(meta::PROGRESS));
+        return format::time_format(s.get<int>(meta::PROGRESS));
     }));
     specifiers.emplace_back(new specifier("duration", meta::DURATION, [](song const& s) -> QString {
-        return time_format(s.get<int>(meta::DURATION));
+        return s.derived()->duration;
     }));
     specifiers.emplace_back(new specifier("time_left", { meta::PROGRESS, meta::DURATION }, [](song const& s) -> QString {
-        return time_format(s.get<int>(meta::DURATION) - s.get<int>(meta::PROGRESS));
+        return format::time_format(s.get<int>(meta::DURATION) - s.get<int>(meta::PROGRESS));
     }));
 
     specifiers.emplace_back(new specifier("release_date", meta::RELEASE, [](song const& s) -> QString {
-        auto day = s.has(meta::RELEASE_DAY);
-        auto month = s.has(meta::RELEASE_MONTH);
-        auto year = s.has(meta::RELEASE_YEAR);
-
-        if (day && month && year) {
-            QDate d;
-            d.setDate(s.get<int>(meta::RELEASE_YEAR), s.get<int>(meta::RELEASE_MONTH), s.get<int>(meta::RELEASE_DAY));
-            return QLocale::system().toString(d, QLocale::ShortFormat);
-        } else if (month && year) {
-            return QString("%1.%2").arg(s.get<int>(meta::RELEASE_YEAR), s.get<int>(meta::RELEASE_MONTH));
-        } else if (year) {
-            return QString::number(s.get<int>(meta::RELEASE_YEAR));
-        }
-        return "";
+        return s.derived()->release_date;
     }));
 
     specifiers.emplace_back(new static_specifier("time", [](song const& s) {
@@ -109,13 +97,10 @@ void init()
     }));
 
     specifiers.emplace_back(new specifier("first_artist", meta::ARTIST, [](song const& s) -> QString {
-        auto l = s.get<QStringList>(meta::ARTIST);
-        if (!l.isEmpty())
-            return l[0];
-        return "";
+        return s.derived()->first_artist;
     }));
     specifiers.emplace_back(new specifier("artists", meta::ARTIST, [](song const& s) -> QString {
-        return s.get<QStringList>(meta::ARTIST).join(", ");
+        return s.derived()->artists;
     }));
     specifiers.emplace_back(new static_specifier("line_break", [](song const&) -> QString {
         return "\n";
@@ -133,6 +118,28 @@ void init()
         return QString(doc.toJson(QJsonDocument::Indented));
     }));
 
+    // Synced lyrics at the current position
+    specifiers.emplace_back(new static_specifier("lyrics_line", [](song const&) -> QString {
+        return lyrics::current_line();
+    }));
+    specifiers.emplace_back(new static_specifier("lyrics_next", [](song const&) -> QString {
+        return lyrics::next_line();
+    }));
+
+    // Colors of the current cover as #rrggbb
+    specifiers.emplace_back(new static_specifier("cover_color_dominant", [](song const&) -> QString {
+        auto colors = cover_pipeline::current_palette();
+        return colors.valid() ? colors.dominant.name() : "";
+    }));
+    specifiers.emplace_back(new static_specifier("cover_color_vibrant", [](song const&) -> QString {
+        auto colors = cover_pipeline::current_palette();
+        return colors.valid() ? colors.vibrant.name() : "";
+    }));
+    specifiers.emplace_back(new static_specifier("cover_color_muted", [](song const&) -> QString {
+        auto colors = cover_pipeline::current_palette();
+        return colors.valid() ? colors.muted.name() : "";
+    }));
+
     // Spotify
     specifiers.emplace_back(new specifier("playlist_url", meta::CONTEXT_URL));
     specifiers.emplace_back(new specifier("playlist_name", meta::PLAYLIST_NAME));
@@ -162,18 +169,42 @@ void init()
 }
 
 bool execute(QString& q)
+{
+    return execute(q, music_sources::selected_source()->song_info());
+}
+
+bool execute(QString& q, song const& s)
 {
     auto src_ref = music_sources::selected_source();
     auto copy = q;
     auto result = true;
     q = "";
 
-    auto handle_specifier = [&copy](QString::Iterator& it, int& truncate, bool& uppercase, bool& proper_formatting) -> specifier const* {
+    auto handle_specifier = [&copy](QString::Iterator& it, QString& vlc_name, int& truncate, bool& uppercase, bool& proper_formatting) -> specifier const* {
         QString id = "";
 
-        while (it != copy.end() && *it != '}' && *it != ':') {
-            id += *it;
+        auto read_id = [&]() {
+            id = "";
+            while (it != copy.end() && *it != '}' && *it != ':') {
+                id += *it;
+                ++it;
+            }
+        };
+
+        read_id();
+
+        /* {vlc:<source name>:title} reads from that VLC source instead of
+         * the selected music source */
+        if (id.toLower() == S_SOURCE_VLC && it != copy.end() && *it == ':') {
             ++it;
+            while (it != copy.end() && *it != '}' && *it != ':') {
+                vlc_name += *it;
+                ++it;
+            }
+            if (it == copy.end() || *it != ':')
+                return nullptr;
+            ++it;
+            read_id();
         }
 
         if (*it == ':') {
@@ -209,10 +240,20 @@ bool execute(QString& q)
             int truncate = 0;
             bool uppercase = false;
             bool formatting = false;
-            if (auto* spec = handle_specifier(it, truncate, uppercase, formatting)) {
-                auto data = spec->get_data(src_ref->song_info());
-                if (!src_ref->provides_metadata(spec->get_required_caps()))
-                    result = false;
+            QString vlc_name;
+            if (auto* spec = handle_specifier(it, vlc_name, truncate, uppercase, formatting)) {
+                QString data;
+                if (vlc_name.isEmpty()) {
+                    data = spec->get_data(s);
+                    if (!src_ref->provides_metadata(spec->get_required_caps()))
+                        result = false;
+                } else {
+                    auto vlc = music_sources::get<vlc_obs_source>(S_SOURCE_VLC);
+                    if (vlc && vlc->enabled())
+                        data = spec->get_data(vlc->song_for(qt_to_utf8(vlc_name)));
+                    if (!vlc || !vlc->provides_metadata(spec->get_required_caps()))
+                        result = false;
+                }
                 if (truncate > 0 && data.length() > truncate) {
                     data.truncate(truncate);
                     data.append("...");
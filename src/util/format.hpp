@@ -30,6 +30,12 @@ namespace format {
 
 void init();
 bool execute(QString& out);
+/* Uses this song instead of the one of the selected source, e.g. the copy
+ * made for the obs sources */
+bool execute(QString& out, song const& s);
+
+/* Formats milliseconds as m:ss or h:mm:ss */
+QString time_format(int32_t ms);
 
 class specifier {
 protected:
@@ -0,0 +1,274 @@
+/*************************************************************************
+ * This file is part of tuna
+ * git.vrsal.xyz/alex/tuna
+ * Copyright 2023 univrsal <uni@vrsal.xyz>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#include "icy_reader.hpp"
+#include "constants.hpp"
+#include "rate_limiter.hpp"
+#include "utility.hpp"
+#include <QStringDecoder>
+#include <algorithm>
+#include <curl/curl.h>
+#include <util/platform.h>
+
+/* Readers disconnect if nobody asked for the title for this long */
+#define IDLE_TIMEOUT_MS 30000
+
+namespace util {
+
+static inline uint64_t now_ms()
+{
+    return os_gettime_ns() / 1000000;
+}
+
+bool icy_reader::parser::feed(const char*& data, size_t& length)
+{
+    while (length > 0) {
+        if (!in_meta) {
+            if (audio_left > 0) {
+                auto skip = uint32_t(std::min<size_t>(audio_left, length));
+                audio_left -= skip;
+                data += skip;
+                length -= skip;
+                continue;
+            }
+
+            /* Every metadata block starts with its length in 16 byte units,
+             * most of the time it's zero because nothing changed */
+            meta_left = uint32_t(uint8_t(*data)) * 16;
+            data++;
+            length--;
+            meta.clear();
+            if (meta_left == 0)
+                audio_left = metaint;
+            else
+                in_meta = true;
+        } else {
+            auto n = uint32_t(std::min<size_t>(meta_left, length));
+            meta.append(data, n);
+            meta_left -= n;
+            data += n;
+            length -= n;
+            if (meta_left == 0) {
+                in_meta = false;
+                audio_left = metaint;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool icy_reader::parser::stream_title(const std::string& meta, std::string& title)
+{
+    /* StreamTitle='Artist - Title';StreamUrl='...'; padded with zeroes */
+    static const std::string key = "StreamTitle='";
+    auto start = meta.find(key);
+    if (start == std::string::npos)
+        return false;
+    start += key.length();
+
+    /* Titles can contain apostrophes, so look for the terminator */
+    auto end = meta.find("';", start);
+    if (end == std::string::npos)
+        end = meta.rfind('\'');
+    if (end == std::string::npos || end < start)
+        end = meta.find('\0', start);
+
+    title = meta.substr(start, end == std::string::npos ? std::string::npos : end - start);
+    return true;
+}
+
+icy_reader::~icy_reader()
+{
+    stop();
+}
+
+void icy_reader::start(const QString& url)
+{
+    std::lock_guard<std::mutex> lock(m_control_mutex);
+    m_last_access = now_ms();
+    if (m_running && url == m_url)
+        return;
+
+    m_running = false;
+    if (m_thread.joinable())
+        m_thread.join();
+
+    /* Don't retry streams that can't be read at all */
+    if (url.isEmpty() || url == m_failed_url)
+        return;
+
+    {
+        std::lock_guard<std::mutex> title_lock(m_title_mutex);
+        m_title.clear();
+    }
+    m_url = url;
+    m_failed_url.clear();
+    m_running = true;
+    m_thread = std::thread(&icy_reader::thread_method, this);
+}
+
+void icy_reader::stop()
+{
+    std::lock_guard<std::mutex> lock(m_control_mutex);
+    m_running = false;
+    if (m_thread.joinable())
+        m_thread.join();
+    m_failed_url.clear();
+}
+
+QString icy_reader::title()
+{
+    m_last_access = now_ms();
+    std::string raw;
+    {
+        std::lock_guard<std::mutex> lock(m_title_mutex);
+        raw = m_title;
+    }
+
+    /* Most stations send utf-8 but older ones still use latin-1 */
+    QStringDecoder decode(QStringDecoder::Utf8);
+    QString result = decode(QByteArray::fromStdString(raw));
+    if (decode.hasError())
+        result = QString::fromLatin1(raw.c_str(), qsizetype(raw.length()));
+    return result.trimmed();
+}
+
+void icy_reader::thread_method()
+{
+    util::set_thread_name("tuna-icy");
+    binfo("Reading stream metadata from %s", qt_to_utf8(m_url));
+
+    while (m_running) {
+        if (rate_limiter::acquire(m_url) && !read_stream())
+            break;
+
+        /* Don't hammer the server if the connection keeps dropping */
+        int64_t wait = std::max<int64_t>(int64_t(rate_limiter::wait_time_ms(m_url)), 1000);
+        while (wait > 0 && m_running) {
+            os_sleep_ms(50);
+            wait -= 50;
+        }
+    }
+    m_running = false;
+    binfo("Stopped reading stream metadata from %s", qt_to_utf8(m_url));
+}
+
+bool icy_reader::read_stream()
+{
+    struct connection {
+        icy_reader* reader;
+        parser p;
+        std::string header;
+        bool no_metadata = false;
+        bool idle = false;
+    } c { this };
+
+    auto* curl = curl_easy_init();
+    if (!curl)
+        return false;
+
+    auto header_callback = [](char* ptr, size_t size, size_t nmemb, connection* c) -> size_t {
+        size_t length = size * nmemb;
+        std::string line(ptr, length);
+        auto metaint = get_header_value(line, "icy-metaint");
+        if (!metaint.empty())
+            c->p.metaint = c->p.audio_left = uint32_t(strtoul(metaint.c_str(), nullptr, 10));
+        c->header.append(line);
+        return length;
+    };
+
+    auto write_callback = [](char* ptr, size_t size, size_t nmemb, connection* c) -> size_t {
+        size_t length = size * nmemb;
+        if (!c->reader->m_running)
+            return 0;
+
+        /* The server ignored Icy-MetaData, this is just audio */
+        if (c->p.metaint == 0) {
+            c->no_metadata = true;
+            return 0;
+        }
+
+        const char* data = ptr;
+        size_t left = length;
+        while (left > 0) {
+            std::string title;
+            if (c->p.feed(data, left) && parser::stream_title(c->p.meta, title)) {
+                std::lock_guard<std::mutex> lock(c->reader->m_title_mutex);
+                if (title != c->reader->m_title)
+                    bdebug("New stream title: %s", title.c_str());
+                c->reader->m_title = title;
+            }
+        }
+        return length;
+    };
+
+    auto progress_callback = [](void* data, curl_off_t, curl_off_t, curl_off_t, curl_off_t) -> int {
+        auto* c = static_cast<connection*>(data);
+        uint64_t now = now_ms(), last = c->reader->m_last_access;
+        if (now > last && now - last > IDLE_TIMEOUT_MS)
+            c->idle = true;
+        return c->idle || !c->reader->m_running;
+    };
+
+    struct curl_slist* list = curl_slist_append(nullptr, "Icy-MetaData: 1");
+    curl_easy_setopt(curl, CURLOPT_URL, qt_to_utf8(m_url));
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, list);
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
+    /* Stalled streams are dropped and reconnected */
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 30L);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, static_cast<size_t (*)(char*, size_t, size_t, connection*)>(header_callback));
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &c);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, static_cast<size_t (*)(char*, size_t, size_t, connection*)>(write_callback));
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &c);
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, static_cast<int (*)(void*, curl_off_t, curl_off_t, curl_off_t, curl_off_t)>(progress_callback));
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &c);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+
+    long http_code = -1;
+    auto result = curl_easy_perform(curl);
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+    curl_slist_free_all(list);
+    curl_easy_cleanup(curl);
+
+    if (c.idle || !m_running)
+        return false;
+
+    /* Dropped connections count as failures so reconnects back off */
+    bool failed = result != CURLE_OK && !c.no_metadata;
+    rate_limiter::report(m_url, failed ? -1 : http_code, c.header);
+
+    if (http_code >= 400 && http_code < 500 && http_code != STATUS_RETRY_AFTER) {
+        berr("The stream at %s responded with error code %i", qt_to_utf8(m_url), int(http_code));
+        m_failed_url = m_url;
+        return false;
+    }
+
+    if (c.no_metadata) {
+        berr("The stream at %s doesn't provide metadata", qt_to_utf8(m_url));
+        m_failed_url = m_url;
+        return false;
+    }
+
+    if (failed)
+        bwarn("Lost connection to stream %s: %s", qt_to_utf8(m_url), curl_easy_strerror(result));
+    return true;
+}
+}
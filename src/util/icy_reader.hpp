@@ -0,0 +1,69 @@
+/*************************************************************************
+ * This file is part of tuna
+ * git.vrsal.xyz/alex/tuna
+ * Copyright 2023 univrsal <uni@vrsal.xyz>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#pragma once
+#include <QString>
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+
+namespace util {
+
+/* Reads the in-band metadata of an Icecast/Shoutcast stream. The stream is
+ * requested with "Icy-MetaData: 1" and the server then inserts a metadata
+ * block after every icy-metaint bytes of audio. The audio itself is skipped
+ * without being buffered, so this only keeps a single connection open
+ * and picks up title changes as soon as the station sends them */
+class icy_reader {
+    QString m_url, m_failed_url;
+    std::thread m_thread;
+    std::atomic<bool> m_running { false };
+    std::mutex m_control_mutex, m_title_mutex;
+    std::string m_title;
+    std::atomic<uint64_t> m_last_access { 0 };
+
+    void thread_method();
+    bool read_stream();
+
+public:
+    ~icy_reader();
+
+    /* Connects to the stream, if the reader is already connected to a
+     * different url the connection is replaced */
+    void start(const QString& url);
+    void stop();
+
+    /* Latest StreamTitle sent by the server, readers which aren't accessed
+     * for a while disconnect on their own */
+    QString title();
+
+    struct parser {
+        uint32_t metaint = 0;
+        uint32_t audio_left = 0;
+        uint32_t meta_left = 0;
+        bool in_meta = false;
+        std::string meta;
+
+        /* Returns true if a complete metadata block was read into meta */
+        bool feed(const char*& data, size_t& length);
+        static bool stream_title(const std::string& meta, std::string& title);
+    };
+};
+}
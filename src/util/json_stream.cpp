@@ -0,0 +1,269 @@
+/*************************************************************************
+ * This file is part of tuna
+ * git.vrsal.xyz/alex/tuna
+ * Copyright 2023 univrsal <uni@vrsal.xyz>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#include "json_stream.hpp"
+#include <cctype>
+
+namespace util {
+
+json_stream::json_stream(callback cb, size_t max_token_length, size_t max_depth)
+    : m_callback(cb)
+    , m_max_token_length(max_token_length)
+    , m_max_depth(max_depth)
+{
+}
+
+bool json_stream::emit(event e)
+{
+    if (!m_callback(e, *this)) {
+        m_stopped = true;
+        return false;
+    }
+    return true;
+}
+
+bool json_stream::fail(const char* error)
+{
+    m_error = error;
+    return false;
+}
+
+bool json_stream::append(char c)
+{
+    if (m_token.length() >= m_max_token_length)
+        return fail("Token exceeds maximum length");
+    m_token.push_back(c);
+    return true;
+}
+
+bool json_stream::append_codepoint(uint32_t cp)
+{
+    /* Surrogate pairs are split across two \u escapes */
+    if (cp >= 0xD800 && cp < 0xDC00) {
+        m_high_surrogate = cp;
+        return true;
+    }
+
+    if (cp >= 0xDC00 && cp < 0xE000) {
+        if (m_high_surrogate == 0)
+            cp = 0xFFFD;
+        else
+            cp = 0x10000 + ((m_high_surrogate - 0xD800) << 10) + (cp - 0xDC00);
+    }
+    m_high_surrogate = 0;
+
+    bool ok;
+    if (cp < 0x80) {
+        ok = append(char(cp));
+    } else if (cp < 0x800) {
+        ok = append(char(0xC0 | (cp >> 6))) && append(char(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+        ok = append(char(0xE0 | (cp >> 12))) && append(char(0x80 | ((cp >> 6) & 0x3F)))
+            && append(char(0x80 | (cp & 0x3F)));
+    } else {
+        ok = append(char(0xF0 | (cp >> 18))) && append(char(0x80 | ((cp >> 12) & 0x3F)))
+            && append(char(0x80 | ((cp >> 6) & 0x3F))) && append(char(0x80 | (cp & 0x3F)));
+    }
+    return ok;
+}
+
+bool json_stream::begin_value(char c)
+{
+    m_token.clear();
+    if (c == '{' || c == '[') {
+        if (m_path.size() >= m_max_depth)
+            return fail("Maximum nesting depth exceeded");
+        m_path.push_back(m_key);
+        m_containers.push_back(c);
+        if (!emit(c == '{' ? object_begin : array_begin))
+            return false;
+        m_key.clear();
+        m_state = c == '{' ? state::key_or_end : state::value_or_end;
+    } else if (c == '"') {
+        m_string_is_key = false;
+        m_state = state::in_string;
+    } else if (c == '-' || c == 't' || c == 'f' || c == 'n' || isdigit((unsigned char)c)) {
+        m_state = state::in_literal;
+        return append(c);
+    } else {
+        return fail("Unexpected character, expected a value");
+    }
+    return true;
+}
+
+bool json_stream::end_container(char c)
+{
+    if (m_containers.empty() || m_containers.back() != (c == '}' ? '{' : '['))
+        return fail("Mismatched brackets");
+
+    m_token.clear();
+    m_key = m_path.back();
+    if (!emit(c == '}' ? object_end : array_end))
+        return false;
+    m_path.pop_back();
+    m_containers.pop_back();
+    m_state = m_containers.empty() ? state::done : state::after_value;
+    return true;
+}
+
+bool json_stream::end_value()
+{
+    m_state = m_containers.empty() ? state::done : state::after_value;
+    return true;
+}
+
+bool json_stream::feed(const char* data, size_t length)
+{
+    if (m_stopped || failed())
+        return false;
+
+    size_t i = 0;
+    while (i < length) {
+        char c = data[i];
+
+        switch (m_state) {
+        case state::in_string:
+            if (c == '"') {
+                if (m_string_is_key) {
+                    m_key = m_token;
+                    m_state = state::colon;
+                } else if (!emit(string) || !end_value()) {
+                    return false;
+                }
+            } else if (c == '\\') {
+                m_state = state::in_escape;
+            } else if (!append(c)) {
+                return false;
+            }
+            break;
+        case state::in_escape: {
+            bool ok = true;
+            m_state = state::in_string;
+            switch (c) {
+            case 'b':
+                ok = append('\b');
+                break;
+            case 'f':
+                ok = append('\f');
+                break;
+            case 'n':
+                ok = append('\n');
+                break;
+            case 'r':
+                ok = append('\r');
+                break;
+            case 't':
+                ok = append('\t');
+                break;
+            case 'u':
+                m_unicode = 0;
+                m_unicode_digits = 0;
+                m_state = state::in_unicode;
+                break;
+            case '"':
+            case '\\':
+            case '/':
+                ok = append(c);
+                break;
+            default:
+                return fail("Invalid escape sequence");
+            }
+            if (!ok)
+                return false;
+            break;
+        }
+        case state::in_unicode:
+            if (!isxdigit((unsigned char)c))
+                return fail("Invalid unicode escape sequence");
+            m_unicode = (m_unicode << 4) | uint32_t(isdigit((unsigned char)c) ? c - '0' : (tolower(c) - 'a' + 10));
+            if (++m_unicode_digits == 4) {
+                m_state = state::in_string;
+                if (!append_codepoint(m_unicode))
+                    return false;
+            }
+            break;
+        case state::in_literal:
+            if (isalnum((unsigned char)c) || c == '.' || c == '-' || c == '+') {
+                if (!append(c))
+                    return false;
+                break;
+            }
+            if (!emit(literal) || !end_value())
+                return false;
+            continue; /* Character belongs to whatever comes after the literal */
+        default:
+            if (isspace((unsigned char)c))
+                break;
+
+            switch (m_state) {
+            case state::value_or_end:
+                if (c == ']') {
+                    if (!end_container(c))
+                        return false;
+                    break;
+                }
+                /* fallthrough */
+            case state::value:
+                if (!begin_value(c))
+                    return false;
+                break;
+            case state::key_or_end:
+                if (c == '}') {
+                    if (!end_container(c))
+                        return false;
+                    break;
+                }
+                /* fallthrough */
+            case state::key:
+                if (c != '"')
+                    return fail("Unexpected character, expected a key");
+                m_token.clear();
+                m_string_is_key = true;
+                m_state = state::in_string;
+                break;
+            case state::colon:
+                if (c != ':')
+                    return fail("Unexpected character, expected ':'");
+                m_state = state::value;
+                break;
+            case state::after_value:
+                if (c == ',') {
+                    if (m_containers.back() == '{') {
+                        m_state = state::key;
+                    } else {
+                        m_key.clear();
+                        m_state = state::value;
+                    }
+                } else if (c == '}' || c == ']') {
+                    if (!end_container(c))
+                        return false;
+                } else {
+                    return fail("Unexpected character, expected ',' or closing bracket");
+                }
+                break;
+            case state::done:
+                return fail("Unexpected data after end of document");
+            default:
+                break;
+            }
+        }
+        i++;
+    }
+    return true;
+}
+}
@@ -0,0 +1,104 @@
+/*************************************************************************
+ * This file is part of tuna
+ * git.vrsal.xyz/alex/tuna
+ * Copyright 2023 univrsal <uni@vrsal.xyz>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#pragma once
+#include <functional>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace util {
+
+/* Incremental json parser which can be fed with arbitrarily sized chunks
+ * of data, for example straight from a curl write callback. Nothing but the
+ * current token and the keys of all open containers is kept in memory and
+ * parsing can be stopped at any point by returning false from the callback */
+class json_stream {
+public:
+    enum event {
+        object_begin,
+        object_end,
+        array_begin,
+        array_end,
+        string,
+        literal /* numbers, true, false and null */
+    };
+
+    /* Return false to stop parsing */
+    typedef std::function<bool(event, const json_stream&)> callback;
+
+    json_stream(callback cb, size_t max_token_length = 64 * 1024, size_t max_depth = 64);
+
+    /* Returns false if parsing was stopped by the callback or failed */
+    bool feed(const char* data, size_t length);
+
+    bool failed() const { return !m_error.empty(); }
+    bool stopped() const { return m_stopped; }
+    bool done() const { return m_state == state::done; }
+    const std::string& error() const { return m_error; }
+
+    /* Number of open containers, including the one that was just opened */
+    size_t depth() const { return m_path.size(); }
+
+    /* Keys of all open containers, array elements have an empty key */
+    const std::vector<std::string>& path() const { return m_path; }
+
+    /* Key of the current value or container inside of its parent object */
+    const std::string& key() const { return m_key; }
+
+    /* Unescaped content of the current string or literal */
+    const std::string& value() const { return m_token; }
+
+private:
+    enum class state {
+        value,
+        value_or_end, /* after [ */
+        key,
+        key_or_end, /* after { */
+        colon,
+        after_value,
+        in_string,
+        in_escape,
+        in_unicode,
+        in_literal,
+        done
+    };
+
+    callback m_callback;
+    size_t m_max_token_length, m_max_depth;
+    state m_state = state::value;
+    bool m_string_is_key = false;
+    bool m_stopped = false;
+    std::string m_error;
+
+    std::string m_token, m_key;
+    std::vector<std::string> m_path;
+    std::vector<char> m_containers;
+
+    uint32_t m_unicode = 0, m_high_surrogate = 0;
+    int m_unicode_digits = 0;
+
+    bool emit(event e);
+    bool fail(const char* error);
+    bool append(char c);
+    bool append_codepoint(uint32_t cp);
+    bool begin_value(char c);
+    bool end_container(char c);
+    bool end_value();
+};
+}
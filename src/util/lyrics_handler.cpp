@@ -17,46 +17,521 @@
  *************************************************************************/
 
 #include "lyrics_handler.hpp"
+#include "../query/song.hpp"
+#include "config.hpp"
+#include "constants.hpp"
+#include "tag_file.hpp"
 #include "utility.hpp"
-#include <taglib/fileref.h>
-#include <taglib/tpropertymap.h>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRegularExpression>
+#include <QTextStream>
+#include <QUrl>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
+#include <taglib/apefile.h>
+#include <taglib/apetag.h>
+#include <taglib/asffile.h>
+#include <taglib/flacfile.h>
+#include <taglib/id3v2tag.h>
+#include <taglib/mp4file.h>
+#include <taglib/mpcfile.h>
+#include <taglib/mpegfile.h>
+#include <taglib/opusfile.h>
+#include <taglib/synchronizedlyricsframe.h>
+#include <taglib/unsynchronizedlyricsframe.h>
+#include <taglib/vorbisfile.h>
+#include <taglib/wavpackfile.h>
+#include <taglib/xiphcomment.h>
+#include <thread>
+#include <util/platform.h>
+
+/* Sources that only report whole seconds would otherwise make the current
+ * line jump back and forth on every refresh */
+#define MAX_PROGRESS_DRIFT 1500
+
+/* Requests that got no final answer are tried again for the same song, but
+ * the delay doubles with every failure */
+#define MIN_RETRY_MS 5000
+#define MAX_RETRY_MS 300000
+
 namespace lyrics {
 
-bool download_missing_lyrics(const song&)
+static std::mutex mutex;
+static std::condition_variable cv;
+static std::vector<line> lines;
+static QString source_text; /* Unparsed text of the current lyrics */
+static bool has_lyrics = true; /* The file might still contain old lyrics */
+static uint64_t revision = 0;
+
+static int32_t anchor_progress = 0;
+static uint64_t anchor_time = 0;
+static bool playing = false;
+
+static std::thread thread_handle;
+static bool thread_flag = false;
+
+/* Last song that was looked up with the provider */
+static uint64_t provider_key = 0;
+static QString provider_text;
+static uint64_t retry_at = 0; /* ms, zero if the answer was final */
+static uint32_t failures = 0;
+
+static inline uint64_t now_ms()
 {
-    /* TODO */
-    return false;
+    return os_gettime_ns() / 1000000;
 }
 
-bool get_embedded(TagLib::FileRef fr)
+/* Requires the mutex to be held */
+static int32_t progress()
 {
-    bool found = false;
-    TagLib::PropertyMap tags = fr.file()->properties();
+    if (!playing)
+        return anchor_progress;
+    return anchor_progress + int32_t((os_gettime_ns() - anchor_time) / 1000000);
+}
 
-    for (TagLib::PropertyMap::ConstIterator i = tags.begin(); i != tags.end(); ++i) {
-        for (TagLib::StringList::ConstIterator j = i->second.begin(); j != i->second.end(); ++j) {
-            if (utf8_to_qt(i->first.toCString(true)).toLower().contains("lyrics")) {
-                return util::write_lyrics(utf8_to_qt((*j).toCString(true)));
-            }
-        }
-    }
-    return found;
+/* Requires the mutex to be held, -1 if the first line hasn't started yet */
+static int index_at(int32_t time)
+{
+    auto it = std::upper_bound(lines.begin(), lines.end(), time, [](int32_t t, line const& l) {
+        return t < l.time;
+    });
+    return int(it - lines.begin()) - 1;
 }
 
-bool find_embedded_lyrics(const QString& path)
+static void write_line(QString const& text)
 {
-#ifdef _WIN32
-    // Windoze can't into utf8
-    const auto wstr = path.toStdWString();
-    const TagLib::FileRef fr(wstr.c_str(), false);
+    if (config::lyrics_line_path.isEmpty())
+        return;
+
+    QFile out(config::lyrics_line_path);
+    if (out.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        QTextStream stream(&out);
+#if QT_VERSION_MAJOR < 6
+        stream.setCodec("UTF-8");
 #else
-    const TagLib::FileRef fr(qt_to_utf8(path), false);
+        stream.setEncoding(QStringConverter::Utf8);
 #endif
+        stream << text;
+        stream.flush();
+        out.close();
+    } else {
+        berr("Failed to write lyrics line file at %s", qt_to_utf8(config::lyrics_line_path));
+    }
+}
+
+/* Text is what is written to the lyrics file, source what it was parsed from */
+static void store(std::vector<line>&& timed, QString const& text, QString const& source)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        lines = std::move(timed);
+        source_text = source;
+        has_lyrics = true;
+        revision++;
+    }
+    cv.notify_all();
+    util::write_lyrics(text);
+}
+
+bool parse_lrc(QString const& text, std::vector<line>& out)
+{
+    static const QRegularExpression time_tag(R"(^\[(\d+):(\d{1,2})(?:[.:](\d{1,3}))?\])");
+    static const QRegularExpression offset_tag(R"(^\[offset:\s*([+-]?\d+)\s*\]$)", QRegularExpression::CaseInsensitiveOption);
+    /* Word timings of the enhanced LRC format */
+    static const QRegularExpression word_tag(R"(<\d+:\d{1,2}(?:[.:]\d{1,3})?>)");
+
+    out.clear();
+    int32_t offset = 0;
+    std::vector<int32_t> times;
+
+    for (auto raw : text.split('\n')) {
+        auto str = raw.trimmed();
+        auto offset_match = offset_tag.match(str);
+        if (offset_match.hasMatch()) {
+            offset = offset_match.captured(1).toInt();
+            continue;
+        }
+
+        /* A line can have multiple timestamps if it's repeated */
+        times.clear();
+        for (auto m = time_tag.match(str); m.hasMatch(); m = time_tag.match(str)) {
+            int32_t ms = (m.captured(1).toInt() * 60 + m.captured(2).toInt()) * 1000;
+            auto fraction = m.captured(3);
+            if (!fraction.isEmpty())
+                ms += fraction.toInt() * (fraction.length() == 1 ? 100 : fraction.length() == 2 ? 10 : 1);
+            times.push_back(ms);
+            str = str.mid(m.capturedLength());
+        }
+
+        str.remove(word_tag);
+        for (auto t : times)
+            out.push_back({ t, str.trimmed() });
+    }
+
+    /* A positive offset makes the lyrics appear earlier */
+    for (auto& l : out)
+        l.time = std::max(l.time - offset, 0);
+    std::stable_sort(out.begin(), out.end(), [](line const& a, line const& b) { return a.time < b.time; });
+    return !out.empty();
+}
+
+void set(QString const& text)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (has_lyrics && text == source_text)
+            return;
+    }
 
-    if (fr.isNull())
+    std::vector<line> timed;
+    if (!parse_lrc(text, timed)) {
+        store({}, text, text);
+        return;
+    }
+
+    QStringList plain;
+    for (auto const& l : timed)
+        plain.append(l.text);
+    store(std::move(timed), plain.join('\n'), text);
+}
+
+void set(std::vector<line>&& timed)
+{
+    std::stable_sort(timed.begin(), timed.end(), [](line const& a, line const& b) { return a.time < b.time; });
+    QStringList plain;
+    for (auto const& l : timed)
+        plain.append(l.text);
+    auto text = plain.join('\n');
+    store(std::move(timed), text, text);
+}
+
+void clear()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!has_lyrics)
+            return;
+        lines.clear();
+        source_text.clear();
+        has_lyrics = false;
+        revision++;
+    }
+    cv.notify_all();
+    util::reset_lyrics();
+}
+
+bool find_local_lyrics(QString const& path)
+{
+    QFileInfo info(path);
+    QFile f(info.dir().filePath(info.completeBaseName() + ".lrc"));
+    if (!f.open(QIODevice::ReadOnly | QIODevice::Text))
         return false;
+    set(QString::fromUtf8(f.readAll()));
+    return true;
+}
 
-    return get_embedded(fr);
+bool retry_due(song const& s)
+{
+    return retry_at && s.identity() == provider_key && now_ms() >= retry_at;
+}
+
+bool download_missing_lyrics(song const& s)
+{
+    auto url = config::lyrics_provider;
+    if (url.isEmpty() || !s.has(meta::TITLE))
+        return false;
+
+    auto key = s.identity();
+    if (key == provider_key && !retry_due(s)) {
+        if (provider_text.isEmpty())
+            return false;
+        set(provider_text);
+        return true;
+    }
+    if (key != provider_key)
+        failures = 0;
+
+    auto artists = s.get<QStringList>(meta::ARTIST).join(", ");
+    url.replace("{artist}", QUrl::toPercentEncoding(artists));
+    url.replace("{title}", QUrl::toPercentEncoding(s.get(meta::TITLE)));
+    url.replace("{album}", QUrl::toPercentEncoding(s.get(meta::ALBUM)));
+    url.replace("{duration}", QString::number(s.get<int>(meta::DURATION) / 1000));
+
+    /* Answers that aren't json won't change, so they're remembered like
+     * lyrics. Requests that failed without one are tried again later */
+    long code = -1;
+    auto doc = util::curl_get_json(qt_to_utf8(url), &code);
+    provider_key = key;
+    provider_text.clear();
+    retry_at = 0;
+    if (doc.isNull()) {
+        if (code < 200 || code >= 500 || code == STATUS_RETRY_AFTER) {
+            auto delay = std::min<uint64_t>(uint64_t(MIN_RETRY_MS) << std::min<uint32_t>(failures, 16), MAX_RETRY_MS);
+            retry_at = now_ms() + delay;
+            failures++;
+        }
+        return false;
+    }
+
+    /* Providers either answer with one result or a list of them, the
+     * format is the one used by lrclib.net */
+    QJsonObject obj = doc.object();
+    if (doc.isArray() && !doc.array().isEmpty())
+        obj = doc.array().first().toObject();
+    provider_text = obj["syncedLyrics"].toString();
+    if (provider_text.isEmpty())
+        provider_text = obj["plainLyrics"].toString();
+    if (provider_text.isEmpty())
+        return false;
+    set(provider_text);
+    return true;
+}
+
+/* Embedded lyrics are cached per file version, so replaying a song or
+ * pausing and resuming doesn't read the file again */
+#define MAX_CACHED_FILES 256
+
+struct cached_file {
+    util::file_identity id;
+    embedded_lyrics lyrics;
+    uint64_t last_use;
+};
+
+static std::mutex cache_mutex;
+static QHash<QString, cached_file> file_cache;
+static uint64_t use_counter = 0;
+
+static inline QString to_qt(TagLib::String const& str)
+{
+    return utf8_to_qt(str.toCString(true));
 }
 
+static void read_id3(TagLib::ID3v2::Tag* tag, embedded_lyrics& out)
+{
+    for (auto* frame : tag->frameList("SYLT")) {
+        auto* sylt = dynamic_cast<TagLib::ID3v2::SynchronizedLyricsFrame*>(frame);
+        /* Timestamps in MPEG frames would need the frame rate of the file */
+        if (!sylt || sylt->timestampFormat() != TagLib::ID3v2::SynchronizedLyricsFrame::AbsoluteMilliseconds)
+            continue;
+        for (auto const& t : sylt->synchedText())
+            out.timed.push_back({ int32_t(t.time), to_qt(t.text).trimmed() });
+        if (!out.timed.empty())
+            return;
+    }
+
+    auto const& uslt = tag->frameList("USLT");
+    if (!uslt.isEmpty()) {
+        if (auto* frame = dynamic_cast<TagLib::ID3v2::UnsynchronizedLyricsFrame*>(uslt.front()))
+            out.text = to_qt(frame->text());
+    }
+}
+
+static void read_xiph(TagLib::Ogg::XiphComment* tag, embedded_lyrics& out)
+{
+    auto const& fields = tag->fieldListMap();
+    for (auto const* key : { "LYRICS", "UNSYNCEDLYRICS" }) {
+        auto it = fields.find(key);
+        if (it != fields.end() && !it->second.isEmpty()) {
+            out.text = to_qt(it->second.front());
+            return;
+        }
+    }
+}
+
+static void read_ape(TagLib::APE::Tag* tag, embedded_lyrics& out)
+{
+    auto const& items = tag->itemListMap();
+    auto it = items.find("LYRICS");
+    if (it != items.end())
+        out.text = to_qt(it->second.toString());
+}
+
+void read_embedded(TagLib::File* file, embedded_lyrics& out)
+{
+    if (auto* mpeg = dynamic_cast<TagLib::MPEG::File*>(file)) {
+        if (mpeg->hasID3v2Tag())
+            read_id3(mpeg->ID3v2Tag(), out);
+        if (out.timed.empty() && out.text.isEmpty() && mpeg->hasAPETag())
+            read_ape(mpeg->APETag(), out);
+    } else if (auto* flac = dynamic_cast<TagLib::FLAC::File*>(file)) {
+        if (flac->hasXiphComment())
+            read_xiph(flac->xiphComment(), out);
+        if (out.text.isEmpty() && flac->hasID3v2Tag())
+            read_id3(flac->ID3v2Tag(), out);
+    } else if (auto* vorbis = dynamic_cast<TagLib::Ogg::Vorbis::File*>(file)) {
+        if (vorbis->tag())
+            read_xiph(vorbis->tag(), out);
+    } else if (auto* opus = dynamic_cast<TagLib::Ogg::Opus::File*>(file)) {
+        if (opus->tag())
+            read_xiph(opus->tag(), out);
+    } else if (auto* mp4 = dynamic_cast<TagLib::MP4::File*>(file)) {
+        if (mp4->tag()) {
+            auto const& items = mp4->tag()->itemMap();
+            auto it = items.find("\251lyr");
+            if (it != items.end() && !it->second.toStringList().isEmpty())
+                out.text = to_qt(it->second.toStringList().front());
+        }
+    } else if (auto* asf = dynamic_cast<TagLib::ASF::File*>(file)) {
+        auto const& attributes = asf->tag()->attributeListMap();
+        auto it = attributes.find("WM/Lyrics");
+        if (it != attributes.end() && !it->second.isEmpty())
+            out.text = to_qt(it->second.front().toString());
+    } else if (auto* ape = dynamic_cast<TagLib::APE::File*>(file)) {
+        if (ape->APETag())
+            read_ape(ape->APETag(), out);
+    } else if (auto* mpc = dynamic_cast<TagLib::MPC::File*>(file)) {
+        if (mpc->APETag())
+            read_ape(mpc->APETag(), out);
+    } else if (auto* wv = dynamic_cast<TagLib::WavPack::File*>(file)) {
+        if (wv->APETag())
+            read_ape(wv->APETag(), out);
+    }
+    std::stable_sort(out.timed.begin(), out.timed.end(), [](line const& a, line const& b) { return a.time < b.time; });
+}
+
+/* Requires the cache mutex to be held */
+static void trim_cache()
+{
+    while (file_cache.size() > MAX_CACHED_FILES) {
+        auto oldest = file_cache.begin();
+        for (auto it = file_cache.begin(); it != file_cache.end(); ++it) {
+            if (it.value().last_use < oldest.value().last_use)
+                oldest = it;
+        }
+        file_cache.erase(oldest);
+    }
+}
+
+bool find_embedded_lyrics(tag_file& file)
+{
+    util::file_identity id;
+    if (!util::get_file_identity(file.path(), id))
+        return false;
+
+    embedded_lyrics entry;
+    bool cached = false;
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        auto it = file_cache.find(file.path());
+        if (it != file_cache.end() && it.value().id == id) {
+            it.value().last_use = ++use_counter;
+            entry = it.value().lyrics;
+            cached = true;
+        }
+    }
+
+    if (!cached) {
+        if (file.read(false))
+            entry = file.lyrics();
+
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        file_cache[file.path()] = { id, entry, ++use_counter };
+        trim_cache();
+    }
+
+    if (!entry.timed.empty()) {
+        set(std::move(entry.timed));
+        return true;
+    }
+    if (!entry.text.isEmpty()) {
+        set(entry.text);
+        return true;
+    }
+    return false;
+}
+
+void update_progress(song const& s)
+{
+    bool now_playing = s.get<int>(meta::STATUS) == state_playing;
+    int32_t reported = s.get<int>(meta::PROGRESS);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (now_playing == playing && std::abs(reported - progress()) < MAX_PROGRESS_DRIFT)
+            return;
+        anchor_progress = reported;
+        anchor_time = os_gettime_ns();
+        playing = now_playing;
+    }
+    cv.notify_all();
+}
+
+QString current_line()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    int i = index_at(progress());
+    return i >= 0 ? lines[i].text : QString();
+}
+
+QString next_line()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t i = size_t(index_at(progress()) + 1);
+    return i < lines.size() ? lines[i].text : QString();
+}
+
+uint64_t line_version()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return (revision << 32) | uint32_t(index_at(progress()) + 1);
+}
+
+static void thread_method()
+{
+    util::set_thread_name("tuna-lyrics");
+    int last_index = -2;
+    uint64_t last_revision = 0;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (thread_flag) {
+        auto now = progress();
+        int i = index_at(now);
+
+        if (i != last_index || revision != last_revision) {
+            last_index = i;
+            last_revision = revision;
+            auto text = i >= 0 ? lines[i].text : QString();
+            lock.unlock();
+            write_line(text);
+            lock.lock();
+            continue;
+        }
+
+        /* Sleep until the next line starts, anything that changes the
+         * lyrics or the position wakes us up earlier */
+        auto wait = std::chrono::milliseconds(1000);
+        if (playing && size_t(i + 1) < lines.size())
+            wait = std::min(wait, std::chrono::milliseconds(std::max(lines[i + 1].time - now, 1)));
+        cv.wait_for(lock, wait);
+    }
+}
+
+void start()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (thread_flag)
+        return;
+    thread_flag = true;
+    thread_handle = std::thread(thread_method);
+}
+
+void stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!thread_flag)
+            return;
+        thread_flag = false;
+    }
+    cv.notify_all();
+    thread_handle.join();
+}
 }
@@ -18,12 +18,78 @@
 
 #pragma once
 #include <QString>
+#include <stdint.h>
+#include <vector>
 
 class song;
+class tag_file;
 
+namespace TagLib {
+class File;
+}
+
+/* Lyrics of the current song. The full text is written to the lyrics path,
+ * synced lyrics (LRC files, SYLT frames or the lyrics provider) are also
+ * indexed by time so that the current line can be looked up at the
+ * extrapolated playback position. A separate thread writes the current line
+ * to its own file whenever it changes, independent of the refresh rate */
 namespace lyrics {
 
+struct line {
+    int32_t time; /* ms */
+    QString text;
+};
+
+/* Parses LRC text into lines sorted by time, returns false if the text
+ * doesn't contain any timestamps */
+extern bool parse_lrc(QString const& text, std::vector<line>& out);
+
+/* Sets the lyrics of the current song, LRC text is detected automatically */
+extern void set(QString const& text);
+
+/* Sets already timed lyrics, e.g. from SYLT frames */
+extern void set(std::vector<line>&& lines);
+
+extern void clear();
+
+/* Looks for an .lrc file with the same name as the song file */
+extern bool find_local_lyrics(QString const& path);
+
+/* Asks the configured lyrics provider, only once per song unless the
+ * request failed */
 extern bool download_missing_lyrics(song const&);
 
-extern bool find_embedded_lyrics(QString const&);
+/* True if the last request for this song failed and can be tried again */
+extern bool retry_due(song const&);
+
+/* Lyrics as they are stored in a song file, text is only set if there are
+ * no timed lines */
+struct embedded_lyrics {
+    std::vector<line> timed;
+    QString text;
+};
+
+/* Only looks at the frames that can contain lyrics (USLT/SYLT, Vorbis
+ * comments, MP4 and APE items) instead of converting all tags into a
+ * property map */
+extern void read_embedded(TagLib::File* file, embedded_lyrics& out);
+
+/* Uses the lyrics read from the file, cached per file version */
+extern bool find_embedded_lyrics(tag_file& file);
+
+/* Playback position that the current line is extrapolated from */
+extern void update_progress(song const& s);
+
+/* Line at the extrapolated position and the one after it, empty if the
+ * lyrics aren't synced */
+extern QString current_line();
+extern QString next_line();
+
+/* Changes whenever the lyrics or the current line change, so consumers of
+ * the lines don't have to wait for the next query to notice a new line */
+extern uint64_t line_version();
+
+/* Thread that writes the current line to config::lyrics_line_path */
+extern void start();
+extern void stop();
 }
@@ -0,0 +1,187 @@
+/*************************************************************************
+ * This file is part of tuna
+ * git.vrsal.xyz/alex/tuna
+ * Copyright 2023 univrsal <uni@vrsal.xyz>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#include "rate_limiter.hpp"
+#include "constants.hpp"
+#include "utility.hpp"
+#include <QHash>
+#include <QUrl>
+#include <algorithm>
+#include <cctype>
+#include <ctime>
+#include <curl/curl.h>
+#include <mutex>
+#include <random>
+#include <util/platform.h>
+
+#define MS_TO_NS 1000000ull
+
+namespace rate_limiter {
+
+/* Used for hosts that weren't configured by their source */
+static const double default_rate = 4.0;
+static const double default_burst = 8.0;
+
+/* Backoff starts at one second and doubles up to five minutes */
+static const uint64_t backoff_base_ms = 1000;
+static const uint64_t backoff_max_ms = 5 * 60 * 1000;
+
+struct host_state {
+    double rate = default_rate;
+    double burst = default_burst;
+    double tokens = default_burst;
+    uint64_t last_fill = 0;     /* ns */
+    uint64_t blocked_until = 0; /* ns */
+    uint32_t failures = 0;
+};
+
+static std::mutex mutex;
+static QHash<QString, host_state> hosts;
+
+static inline QString host_of(const QString& url)
+{
+    auto host = QUrl(url).host().toLower();
+    /* Fall back to the whole string for things that aren't urls */
+    return host.isEmpty() ? url : host;
+}
+
+/* Requires the mutex to be held */
+static host_state& get_state(const QString& host, uint64_t now)
+{
+    auto it = hosts.find(host);
+    if (it == hosts.end()) {
+        host_state s;
+        s.last_fill = now;
+        it = hosts.insert(host, s);
+    }
+    return it.value();
+}
+
+static inline void refill(host_state& s, uint64_t now)
+{
+    if (now > s.last_fill) {
+        double elapsed = double(now - s.last_fill) / SECOND_TO_NS;
+        s.tokens = std::min(s.burst, s.tokens + elapsed * s.rate);
+    }
+    s.last_fill = now;
+}
+
+static uint64_t backoff_ms(uint32_t failures)
+{
+    static std::mt19937 rng { std::random_device {}() };
+    uint64_t delay = backoff_base_ms << std::min<uint32_t>(failures - 1, 16);
+    delay = std::min(delay, backoff_max_ms);
+
+    /* Equal jitter: wait at least half of the delay so that the backoff
+     * still grows, but spread out the rest so that requests from multiple
+     * sources don't retry at the same time */
+    std::uniform_int_distribution<uint64_t> dist(0, delay / 2);
+    return delay / 2 + dist(rng);
+}
+
+void configure(const QString& host, double requests_per_second, double burst)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto now = os_gettime_ns();
+    auto& s = get_state(host.toLower(), now);
+    refill(s, now);
+    s.rate = std::max(requests_per_second, 0.001);
+    s.burst = std::max(burst, 1.0);
+    s.tokens = std::min(s.tokens, s.burst);
+}
+
+bool acquire(const QString& url)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto now = os_gettime_ns();
+    auto& s = get_state(host_of(url), now);
+
+    if (now < s.blocked_until)
+        return false;
+
+    refill(s, now);
+    if (s.tokens < 1.0)
+        return false;
+    s.tokens -= 1.0;
+    return true;
+}
+
+uint64_t wait_time_ms(const QString& url)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto now = os_gettime_ns();
+    auto& s = get_state(host_of(url), now);
+    refill(s, now);
+
+    uint64_t wait = 0;
+    if (now < s.blocked_until)
+        wait = (s.blocked_until - now) / MS_TO_NS;
+    if (s.tokens < 1.0)
+        wait = std::max(wait, uint64_t((1.0 - s.tokens) / s.rate * 1000));
+    return wait;
+}
+
+void report(const QString& url, long http_code, const std::string& header)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto host = host_of(url);
+    auto now = os_gettime_ns();
+    auto& s = get_state(host, now);
+
+    if (http_code >= 200 && http_code < 400) {
+        if (s.failures > 0)
+            binfo("Requests to %s are succeeding again", qt_to_utf8(host));
+        s.failures = 0;
+        return;
+    }
+
+    /* Other client errors (invalid token, unknown user etc.) won't go away
+     * by waiting so they only count against the token bucket */
+    bool throttled = http_code == STATUS_RETRY_AFTER || http_code == HTTP_SERVICE_UNAVAILABLE;
+    if (http_code >= 400 && http_code < 500 && !throttled)
+        return;
+
+    s.failures++;
+    auto retry_after = parse_retry_after(header);
+    uint64_t delay = 0;
+    if (retry_after >= 0) {
+        delay = uint64_t(retry_after) * 1000;
+        bwarn("%s asked us to wait %i seconds before the next request", qt_to_utf8(host), int(retry_after));
+    } else {
+        delay = backoff_ms(s.failures);
+        bwarn("Request to %s failed (HTTP %i), backing off for %i ms", qt_to_utf8(host), int(http_code), int(delay));
+    }
+    s.blocked_until = std::max(s.blocked_until, now + delay * MS_TO_NS);
+}
+
+int64_t parse_retry_after(const std::string& header)
+{
+    auto value = util::get_header_value(header, "Retry-After");
+    if (value.empty())
+        return -1;
+
+    /* Either delay-seconds or an HTTP-date */
+    if (std::all_of(value.begin(), value.end(), [](unsigned char c) { return std::isdigit(c); }))
+        return std::min<int64_t>(strtoll(value.c_str(), nullptr, 10), 24 * 60 * 60);
+
+    auto date = curl_getdate(value.c_str(), nullptr);
+    if (date < 0)
+        return -1;
+    return std::max<int64_t>(int64_t(date) - int64_t(time(nullptr)), 0);
+}
+}
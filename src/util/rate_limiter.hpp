@@ -0,0 +1,46 @@
+/*************************************************************************
+ * This file is part of tuna
+ * git.vrsal.xyz/alex/tuna
+ * Copyright 2023 univrsal <uni@vrsal.xyz>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#pragma once
+#include <QString>
+#include <stdint.h>
+#include <string>
+
+/* Shared request scheduler for all remote sources. Every host gets its own
+ * token bucket and failed requests put the host into an exponential backoff
+ * with jitter. Retry-After headers sent by the server take precedence over
+ * the backoff */
+namespace rate_limiter {
+
+/* Sets the sustained request rate and the burst size for a host */
+extern void configure(const QString& host, double requests_per_second, double burst);
+
+/* Consumes a token and returns true if a request to the host of this url
+ * is allowed right now */
+extern bool acquire(const QString& url);
+
+/* Milliseconds until the next request to the host of this url is allowed */
+extern uint64_t wait_time_ms(const QString& url);
+
+/* Reports the result of a request, use -1 as the http code if the transfer
+ * itself failed. The response header is only used for Retry-After */
+extern void report(const QString& url, long http_code, const std::string& header = {});
+
+/* Returns the Retry-After value in seconds from a raw response header or -1 */
+extern int64_t parse_retry_after(const std::string& header);
+}
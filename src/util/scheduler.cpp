@@ -0,0 +1,130 @@
+/*************************************************************************
+ * This file is part of tuna
+ * git.vrsal.xyz/alex/tuna
+ * Copyright 2023 univrsal <uni@vrsal.xyz>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#include "scheduler.hpp"
+#include "../query/music_source.hpp"
+#include <algorithm>
+
+refresh_scheduler::refresh_scheduler(uint32_t slot_ms, size_t slot_count)
+    : m_slot_ms(std::max<uint32_t>(slot_ms, 1))
+    , m_slots(std::max<size_t>(slot_count, 1))
+{
+}
+
+void refresh_scheduler::insert(size_t index, uint64_t tick)
+{
+    m_tasks[index].due_tick = tick;
+    m_slots[tick % m_slots.size()].push_back(index);
+}
+
+void refresh_scheduler::remove(size_t index)
+{
+    auto& slot = m_slots[m_tasks[index].due_tick % m_slots.size()];
+    slot.erase(std::remove(slot.begin(), slot.end(), index), slot.end());
+}
+
+void refresh_scheduler::read_cadence(task& t)
+{
+    auto c = t.src->cadence();
+    t.minimum = c.minimum;
+    t.push = c.push;
+    t.interval = std::max(c.preferred, c.minimum);
+}
+
+void refresh_scheduler::set_sources(std::vector<music_source*> const& sources, uint64_t now)
+{
+    for (auto& slot : m_slots)
+        slot.clear();
+    m_tasks.clear();
+
+    m_tick = now / m_slot_ms;
+    for (auto src : sources) {
+        task t {};
+        t.src = src;
+        read_cadence(t);
+        m_tasks.push_back(t);
+        insert(m_tasks.size() - 1, m_tick);
+    }
+}
+
+void refresh_scheduler::update_cadence()
+{
+    for (size_t i = 0; i < m_tasks.size(); i++) {
+        auto& t = m_tasks[i];
+        read_cadence(t);
+        auto tick = tick_of(t.last_run + t.interval);
+        if (tick < t.due_tick) {
+            remove(i);
+            insert(i, std::max(tick, m_tick));
+        }
+    }
+}
+
+void refresh_scheduler::wake(music_source* src, uint64_t now)
+{
+    for (size_t i = 0; i < m_tasks.size(); i++) {
+        auto& t = m_tasks[i];
+        if (t.src != src || !t.push)
+            continue;
+        auto tick = std::max(tick_of(std::max(now, t.last_run + t.minimum)), m_tick);
+        if (tick < t.due_tick) {
+            remove(i);
+            insert(i, tick);
+        }
+    }
+}
+
+void refresh_scheduler::collect_due(uint64_t now, std::vector<music_source*>& out)
+{
+    auto current = now / m_slot_ms;
+    if (current < m_tick)
+        return;
+
+    /* After a long refresh the wheel might have turned more than once, but
+     * every slot still only has to be looked at once */
+    auto from = std::max(m_tick, current >= m_slots.size() ? current - m_slots.size() + 1 : 0);
+    std::vector<size_t> due;
+    for (auto tick = from; tick <= current; tick++) {
+        for (auto index : m_slots[tick % m_slots.size()]) {
+            /* Entries for later turns of the wheel stay in their slot */
+            if (m_tasks[index].due_tick <= current)
+                due.push_back(index);
+        }
+    }
+    m_tick = current + 1;
+
+    std::stable_sort(due.begin(), due.end(), [this](size_t a, size_t b) {
+        return m_tasks[a].due_tick < m_tasks[b].due_tick;
+    });
+
+    for (auto index : due) {
+        auto& t = m_tasks[index];
+        out.push_back(t.src);
+        remove(index);
+        t.last_run = now;
+        insert(index, tick_of(now + t.interval));
+    }
+}
+
+uint64_t refresh_scheduler::next_due() const
+{
+    uint64_t tick = UINT64_MAX;
+    for (auto const& t : m_tasks)
+        tick = std::min(tick, t.due_tick);
+    return m_tasks.empty() ? 0 : tick * m_slot_ms;
+}
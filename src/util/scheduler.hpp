@@ -0,0 +1,70 @@
+/*************************************************************************
+ * This file is part of tuna
+ * git.vrsal.xyz/alex/tuna
+ * Copyright 2023 univrsal <uni@vrsal.xyz>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+class music_source;
+
+/* Timer wheel that decides which sources are due for a refresh. Every
+ * source is refreshed at its own interval, but due times are rounded to
+ * slots, so sources with similar intervals are refreshed in the same wakeup
+ * of the query thread */
+class refresh_scheduler {
+    struct task {
+        music_source* src;
+        uint64_t due_tick;
+        uint64_t last_run; /* ms */
+        uint32_t interval; /* ms */
+        uint32_t minimum;  /* ms */
+        bool push;
+    };
+
+    uint32_t m_slot_ms;
+    std::vector<std::vector<size_t>> m_slots; /* task indices */
+    std::vector<task> m_tasks;
+    uint64_t m_tick = 0; /* first slot that wasn't processed yet */
+
+    /* Due times are rounded up to the next slot */
+    uint64_t tick_of(uint64_t ms) const { return (ms + m_slot_ms - 1) / m_slot_ms; }
+    void insert(size_t index, uint64_t tick);
+    void remove(size_t index);
+    void read_cadence(task& t);
+
+public:
+    refresh_scheduler(uint32_t slot_ms, size_t slot_count);
+
+    /* Replaces all tasks, every source is due immediately */
+    void set_sources(std::vector<music_source*> const& sources, uint64_t now);
+
+    /* Reads the cadence of all sources again, e.g. after the config changed */
+    void update_cadence();
+
+    /* Push sources can be refreshed early, but not more often than their
+     * minimum interval allows. Other sources are only refreshed on time */
+    void wake(music_source* src, uint64_t now);
+
+    /* Appends all sources that are due in the order they became due and
+     * schedules their next refresh */
+    void collect_due(uint64_t now, std::vector<music_source*>& out);
+
+    /* Time of the next due refresh or 0 if there are no sources */
+    uint64_t next_due() const;
+};
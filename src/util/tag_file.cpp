@@ -0,0 +1,256 @@
+/*************************************************************************
+ * This file is part of tuna
+ * git.vrsal.xyz/alex/tuna
+ * Copyright 2023 univrsal <uni@vrsal.xyz>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#include "tag_file.hpp"
+#include "../query/song.hpp"
+#include "config.hpp"
+#include "cover_tag_handler.hpp"
+#include "utility.hpp"
+#include <QFileInfo>
+#include <QHash>
+#include <mutex>
+#include <taglib/apefile.h>
+#include <taglib/apetag.h>
+#include <taglib/asffile.h>
+#include <taglib/fileref.h>
+#include <taglib/flacfile.h>
+#include <taglib/id3v2tag.h>
+#include <taglib/mp4file.h>
+#include <taglib/mpcfile.h>
+#include <taglib/mpegfile.h>
+#include <taglib/opusfile.h>
+#include <taglib/tag.h>
+#include <taglib/vorbisfile.h>
+#include <taglib/wavpackfile.h>
+#include <taglib/xiphcomment.h>
+
+static inline QString to_qt(TagLib::String const& str)
+{
+    return utf8_to_qt(str.toCString(true));
+}
+
+/* Totals are usually stored as "3/12" in the track/disc number */
+static inline int total_of(TagLib::String const& str)
+{
+    auto parts = to_qt(str).split('/');
+    return parts.size() == 2 ? parts[1].trimmed().toInt() : 0;
+}
+
+/* Tags are cached per file version, so replaying a song doesn't read the
+ * file again */
+#define MAX_CACHED_FILES 256
+
+struct cached_tags {
+    util::file_identity id;
+    QString album_artist;
+    QString genre;
+    int track_total;
+    int disc_total;
+    uint64_t last_use;
+};
+
+static std::mutex cache_mutex;
+static QHash<QString, cached_tags> tag_cache;
+static uint64_t use_counter = 0;
+
+/* Requires the cache mutex to be held */
+static void trim_cache()
+{
+    while (tag_cache.size() > MAX_CACHED_FILES) {
+        auto oldest = tag_cache.begin();
+        for (auto it = tag_cache.begin(); it != tag_cache.end(); ++it) {
+            if (it.value().last_use < oldest.value().last_use)
+                oldest = it;
+        }
+        tag_cache.erase(oldest);
+    }
+}
+
+tag_file::tag_file(QString const& path)
+    : m_path(path)
+{
+}
+
+bool tag_file::read(bool picture)
+{
+    if (m_read && (m_picture_read || !picture))
+        return m_valid;
+    m_read = true;
+    m_picture_read = m_picture_read || picture;
+
+    if (!QFileInfo::exists(m_path))
+        return false;
+
+#ifdef _WIN32
+    // Windoze can't into utf8
+    const auto wstr = m_path.toStdWString();
+    const TagLib::FileRef fr(wstr.c_str(), false);
+#else
+    const TagLib::FileRef fr(qt_to_utf8(m_path), false);
+#endif
+    if (fr.isNull()) {
+        bdebug("TagLib couldn't read %s", qt_to_utf8(m_path));
+        return false;
+    }
+
+    auto* file = fr.file();
+    if (picture)
+        m_picture = cover::read_embedded_picture(file);
+    m_lyrics = {};
+    lyrics::read_embedded(file, m_lyrics);
+
+    if (file->tag())
+        m_genre = to_qt(file->tag()->genre());
+
+    auto read_id3 = [this](TagLib::ID3v2::Tag* tag) {
+        auto const& frames = tag->frameListMap();
+        auto it = frames.find("TPE2");
+        if (it != frames.end() && !it->second.isEmpty())
+            m_album_artist = to_qt(it->second.front()->toString());
+        it = frames.find("TRCK");
+        if (it != frames.end() && !it->second.isEmpty())
+            m_track_total = total_of(it->second.front()->toString());
+        it = frames.find("TPOS");
+        if (it != frames.end() && !it->second.isEmpty())
+            m_disc_total = total_of(it->second.front()->toString());
+    };
+
+    auto read_xiph = [this](TagLib::Ogg::XiphComment* tag) {
+        auto const& fields = tag->fieldListMap();
+        auto first = [&fields](std::initializer_list<const char*> keys) -> TagLib::String {
+            for (auto const* key : keys) {
+                auto it = fields.find(key);
+                if (it != fields.end() && !it->second.isEmpty())
+                    return it->second.front();
+            }
+            return {};
+        };
+        m_album_artist = to_qt(first({ "ALBUMARTIST", "ALBUM ARTIST" }));
+        m_track_total = to_qt(first({ "TRACKTOTAL", "TOTALTRACKS" })).toInt();
+        m_disc_total = to_qt(first({ "DISCTOTAL", "TOTALDISCS" })).toInt();
+        if (m_track_total == 0)
+            m_track_total = total_of(first({ "TRACKNUMBER" }));
+        if (m_disc_total == 0)
+            m_disc_total = total_of(first({ "DISCNUMBER" }));
+    };
+
+    auto read_ape = [this](TagLib::APE::Tag* tag) {
+        auto const& items = tag->itemListMap();
+        auto it = items.find("ALBUM ARTIST");
+        if (it != items.end())
+            m_album_artist = to_qt(it->second.toString());
+        it = items.find("TRACK");
+        if (it != items.end())
+            m_track_total = total_of(it->second.toString());
+        it = items.find("DISC");
+        if (it != items.end())
+            m_disc_total = total_of(it->second.toString());
+    };
+
+    if (auto* mpeg = dynamic_cast<TagLib::MPEG::File*>(file)) {
+        if (mpeg->hasID3v2Tag())
+            read_id3(mpeg->ID3v2Tag());
+        else if (mpeg->hasAPETag())
+            read_ape(mpeg->APETag());
+    } else if (auto* flac = dynamic_cast<TagLib::FLAC::File*>(file)) {
+        if (flac->hasXiphComment())
+            read_xiph(flac->xiphComment());
+        else if (flac->hasID3v2Tag())
+            read_id3(flac->ID3v2Tag());
+    } else if (auto* vorbis = dynamic_cast<TagLib::Ogg::Vorbis::File*>(file)) {
+        if (vorbis->tag())
+            read_xiph(vorbis->tag());
+    } else if (auto* opus = dynamic_cast<TagLib::Ogg::Opus::File*>(file)) {
+        if (opus->tag())
+            read_xiph(opus->tag());
+    } else if (auto* mp4 = dynamic_cast<TagLib::MP4::File*>(file)) {
+        if (mp4->tag()) {
+            auto const& items = mp4->tag()->itemMap();
+            auto it = items.find("aART");
+            if (it != items.end() && !it->second.toStringList().isEmpty())
+                m_album_artist = to_qt(it->second.toStringList().front());
+            it = items.find("trkn");
+            if (it != items.end())
+                m_track_total = it->second.toIntPair().second;
+            it = items.find("disk");
+            if (it != items.end())
+                m_disc_total = it->second.toIntPair().second;
+        }
+    } else if (auto* asf = dynamic_cast<TagLib::ASF::File*>(file)) {
+        auto const& attributes = asf->tag()->attributeListMap();
+        auto it = attributes.find("WM/AlbumArtist");
+        if (it != attributes.end() && !it->second.isEmpty())
+            m_album_artist = to_qt(it->second.front().toString());
+    } else if (auto* ape = dynamic_cast<TagLib::APE::File*>(file)) {
+        if (ape->APETag())
+            read_ape(ape->APETag());
+    } else if (auto* mpc = dynamic_cast<TagLib::MPC::File*>(file)) {
+        if (mpc->APETag())
+            read_ape(mpc->APETag());
+    } else if (auto* wv = dynamic_cast<TagLib::WavPack::File*>(file)) {
+        if (wv->APETag())
+            read_ape(wv->APETag());
+    }
+
+    m_valid = true;
+    return true;
+}
+
+bool tag_file::from_cache(util::file_identity const& id)
+{
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto it = tag_cache.find(m_path);
+    if (it == tag_cache.end() || !(it.value().id == id))
+        return false;
+    auto& tags = it.value();
+    tags.last_use = ++use_counter;
+    m_album_artist = tags.album_artist;
+    m_genre = tags.genre;
+    m_track_total = tags.track_total;
+    m_disc_total = tags.disc_total;
+    return true;
+}
+
+void tag_file::fill(song& s, QString const& album)
+{
+    if (!m_tags_known) {
+        util::file_identity id;
+        if (!util::get_file_identity(m_path, id))
+            return;
+        m_tags_known = true;
+
+        if (!from_cache(id)) {
+            /* Files that can't be read are cached as well, they won't get any
+             * better until they change */
+            read(config::download_cover && !cover::is_embedded_cover_cached(m_path, album));
+
+            std::lock_guard<std::mutex> lock(cache_mutex);
+            tag_cache[m_path] = { id, m_album_artist, m_genre, m_track_total, m_disc_total, ++use_counter };
+            trim_cache();
+        }
+    }
+
+    if (!m_album_artist.isEmpty() && !s.has(meta::ALBUM_ARTIST))
+        s.set(meta::ALBUM_ARTIST, m_album_artist);
+    if (!m_genre.isEmpty() && !s.has(meta::GENRE))
+        s.set(meta::GENRE, m_genre);
+    if (m_track_total > 0 && !s.has(meta::TRACK_TOTAL))
+        s.set(meta::TRACK_TOTAL, m_track_total);
+    if (m_disc_total > 0 && !s.has(meta::DISC_TOTAL))
+        s.set(meta::DISC_TOTAL, m_disc_total);
+}
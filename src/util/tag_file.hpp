@@ -0,0 +1,68 @@
+/*************************************************************************
+ * This file is part of tuna
+ * git.vrsal.xyz/alex/tuna
+ * Copyright 2023 univrsal <uni@vrsal.xyz>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#pragma once
+#include "lyrics_handler.hpp"
+#include <QByteArray>
+#include <QString>
+
+class song;
+namespace util {
+struct file_identity;
+}
+
+/* A local song file that is read with TagLib in a single pass. The cover,
+ * lyrics and the tags that not every source sends are all extracted at
+ * once the first time anything needs them and the file is closed again
+ * right after. All of them are cached per file version, so the file is only
+ * parsed if one of the caches misses */
+class tag_file {
+    QString m_path;
+    bool m_read = false;
+    bool m_picture_read = false;
+    bool m_valid = false;
+    bool m_tags_known = false; /* read or taken from the cache */
+
+    QByteArray m_picture;
+    lyrics::embedded_lyrics m_lyrics;
+    QString m_album_artist;
+    QString m_genre;
+    int m_track_total = 0;
+    int m_disc_total = 0;
+
+    bool from_cache(util::file_identity const& id);
+
+public:
+    explicit tag_file(QString const& path);
+
+    QString const& path() const { return m_path; }
+
+    /* Parses the file on the first call, false if TagLib can't read it. The
+     * picture is the largest part of most files, so it's only copied if
+     * requested, which parses the file again if it was read without it */
+    bool read(bool picture = true);
+
+    QByteArray const& picture() const { return m_picture; }
+    lyrics::embedded_lyrics const& lyrics() const { return m_lyrics; }
+
+    /* Sets album artist, genre and track/disc totals if the song doesn't
+     * have them yet. Only reads the file if they aren't cached, the picture
+     * is only read as well if covers are enabled and the cover cache doesn't
+     * have it for this file or album */
+    void fill(song& s, QString const& album = {});
+};
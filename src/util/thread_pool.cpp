@@ -0,0 +1,73 @@
+/*************************************************************************
+ * This file is part of tuna
+ * git.vrsal.xyz/alex/tuna
+ * Copyright 2023 univrsal <uni@vrsal.xyz>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#include "thread_pool.hpp"
+#include "utility.hpp"
+
+thread_pool::thread_pool(size_t threads)
+{
+    for (size_t i = 0; i < threads; i++)
+        m_threads.emplace_back(&thread_pool::worker, this);
+}
+
+thread_pool::~thread_pool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_job_cv.notify_all();
+    for (auto& t : m_threads)
+        t.join();
+}
+
+void thread_pool::worker()
+{
+    util::set_thread_name("tuna-pool");
+
+    for (;;) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_job_cv.wait(lock, [this] { return m_stop || !m_jobs.empty(); });
+            if (m_stop && m_jobs.empty())
+                return;
+            job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+        }
+
+        job();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (--m_pending == 0)
+            m_done_cv.notify_all();
+    }
+}
+
+void thread_pool::run(std::vector<std::function<void()>> const& jobs)
+{
+    if (jobs.empty())
+        return;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (auto const& job : jobs)
+        m_jobs.push_back(job);
+    m_pending += jobs.size();
+    m_job_cv.notify_all();
+    m_done_cv.wait(lock, [this] { return m_pending == 0; });
+}
@@ -0,0 +1,47 @@
+/*************************************************************************
+ * This file is part of tuna
+ * git.vrsal.xyz/alex/tuna
+ * Copyright 2023 univrsal <uni@vrsal.xyz>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Fixed set of worker threads, so that sources which are polled at the same
+ * time don't need a new thread on every refresh */
+class thread_pool {
+    std::vector<std::thread> m_threads;
+    std::deque<std::function<void()>> m_jobs;
+    std::mutex m_mutex;
+    std::condition_variable m_job_cv, m_done_cv;
+    size_t m_pending = 0;
+    bool m_stop = false;
+
+    void worker();
+
+public:
+    explicit thread_pool(size_t threads);
+    ~thread_pool();
+
+    size_t size() const { return m_threads.size(); }
+
+    /* Runs all jobs on the pool and waits until every one of them is done */
+    void run(std::vector<std::function<void()>> const& jobs);
+};
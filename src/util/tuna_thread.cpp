@@ -19,24 +19,51 @@
 #include "tuna_thread.hpp"
 #include "../query/music_source.hpp"
 #include "config.hpp"
+#include "lyrics_handler.hpp"
+#include "scheduler.hpp"
+#include "thread_pool.hpp"
 #include "utility.hpp"
 #include <algorithm>
+#include <condition_variable>
 #include <obs-module.h>
 #include <util/platform.h>
 
+/* Refreshes are rounded to 50 ms slots, the wheel covers about 25 seconds */
+#define SLOT_MS 50
+#define SLOT_COUNT 512
+
+/* The thread wakes up at least this often to see if the selected source
+ * changed */
+#define MAX_SLEEP_MS 500
+
+/* Most sources just wait for a response, so a few threads are enough */
+#define MAX_POOL_THREADS 4
+
 namespace tuna_thread {
 std::atomic<bool> thread_flag { false };
 song copy;
+uint64_t copy_version = 0;
 std::mutex thread_mutex;
 std::mutex copy_mutex;
 std::thread thread_handle;
 
+static std::mutex wake_mutex;
+static std::condition_variable wake_cv;
+static std::vector<music_source*> woken_sources;
+
 bool start()
 {
     if (thread_flag)
         return true;
     std::lock_guard<std::mutex> lock(thread_mutex);
+    {
+        /* Sources might have been reloaded since the thread last ran */
+        std::lock_guard<std::mutex> wake_lock(wake_mutex);
+        woken_sources.clear();
+    }
     thread_handle = std::thread(thread_method);
+    if (config::download_lyrics)
+        lyrics::start();
     return thread_flag = thread_handle.native_handle();
 }
 
@@ -45,8 +72,13 @@ void stop()
     if (!thread_flag)
         return;
     bdebug("Stopping query thread...");
-    thread_flag = false;
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        thread_flag = false;
+    }
+    wake_cv.notify_all();
     thread_handle.join();
+    lyrics::stop();
     bdebug("Query thread stopped.");
 
     bdebug("Resetting song information...");
@@ -57,56 +89,134 @@ void stop()
     bdebug("Song information reset.");
 }
 
+void wake(music_source* src)
+{
+    {
+        /* Nobody drains the wakes while the thread isn't running and every
+         * source only has to be woken once */
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        if (!thread_flag || std::find(woken_sources.begin(), woken_sources.end(), src) != woken_sources.end())
+            return;
+        woken_sources.push_back(src);
+    }
+    wake_cv.notify_all();
+}
+
+static inline uint64_t now_ms()
+{
+    return os_gettime_ns() / 1000000;
+}
+
 void thread_method()
 {
     util::set_thread_name("tuna-query");
 
+    refresh_scheduler scheduler(SLOT_MS, SLOT_COUNT);
+    std::unique_ptr<thread_pool> pool;
+    std::shared_ptr<music_source> scheduled_source;
+    std::vector<music_source*> polled, due;
+    bool combined = false;
+
     while (thread_flag) {
-        const uint64_t start = os_gettime_ns() / 1000000;
-        {
-            auto ref = music_sources::selected_source();
-            if (ref) {
-                {
-                    // We don't want to hold the lock while waiting
-                    std::lock_guard<std::mutex> lock(thread_mutex);
+        auto ref = music_sources::selected_source();
+        if (ref) {
+            {
+                std::lock_guard<std::mutex> lock(thread_mutex);
+                auto sources = ref->polled_sources();
+                combined = sources.size() != 1 || sources[0] != ref.get();
+                for (auto const& src : std::as_const(music_sources::instances)) {
+                    if (src->needs_refresh() && std::find(sources.begin(), sources.end(), src.get()) == sources.end())
+                        sources.push_back(src.get());
+                }
+
+                if (ref != scheduled_source || sources != polled) {
+                    scheduler.set_sources(sources, now_ms());
+                    scheduled_source = ref;
+                    polled = sources;
+                } else {
+                    /* Picks up changes to the refresh rate or source settings */
+                    scheduler.update_cadence();
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(wake_mutex);
+                for (auto src : woken_sources)
+                    scheduler.wake(src, now_ms());
+                woken_sources.clear();
+            }
+
+            due.clear();
+            scheduler.collect_due(now_ms(), due);
+        } else {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            woken_sources.clear();
+        }
+
+        if (ref && !due.empty()) {
+            {
+                // We don't want to hold the lock while waiting
+                std::lock_guard<std::mutex> lock(thread_mutex);
+                if (due.size() == 1) {
+                    due[0]->refresh();
+                    due[0]->post_refresh();
+                } else {
+                    /* Every job refreshes one source, so that they can wait
+                     * for their player or server at the same time. Other
+                     * threads only see the song of a source through
+                     * song_info(), which is published in post_refresh() */
+                    auto threads = std::min<size_t>(polled.size(), MAX_POOL_THREADS);
+                    if (!pool || pool->size() != threads)
+                        pool = std::make_unique<thread_pool>(threads);
+
+                    std::vector<std::function<void()>> jobs;
+                    jobs.reserve(due.size());
+                    for (auto src : due) {
+                        jobs.emplace_back([src] {
+                            src->refresh();
+                            src->post_refresh();
+                        });
+                    }
+                    pool->run(jobs);
+                }
+
+                /* The auto source combines the information of its sources */
+                if (combined) {
                     ref->refresh();
                     ref->post_refresh();
                 }
-                auto s = ref->song_info();
-
-                /* Make a copy for the progress bar source, because it can't
-                 * wait for the other processes to finish, otherwise it'll block
-                 * the video thread
-                 */
-                copy_mutex.lock();
-                copy = s;
-                copy_mutex.unlock();
-
-                /* Process song data */
-                util::handle_outputs(s);
-                if (config::download_cover)
-                    ref->handle_cover();
-                if (config::download_lyrics)
-                    ref->handle_lyrics();
             }
-        }
+            auto s = ref->song_info();
+            if (config::download_lyrics)
+                lyrics::update_progress(s);
 
-        /* Calculate how long refresh took and only wait the remaining time
-         * but we wait at least 10 ms otherwise we will immediately lock the mutex
-         * again which can stall other threads that are waiting to lock it
-         */
-        const uint64_t end = os_gettime_ns() / 1000000;
-        uint64_t delta = std::clamp<uint64_t>(end - start, 10ul, config::refresh_rate - 10);
-        int64_t wait = config::refresh_rate - delta;
-        const int64_t step = 50;
-
-        bdebug("Query thread sleeping for %ims", int(wait)); // macOS doesn't like %lu so we'll just cast to int, who cares
-
-        // We only wait int 50 ms steps so we can catch the thread stopping faster
-        while (wait > 0 && thread_flag) {
-            os_sleep_ms(step);
-            wait -= step;
+            /* Make a copy for the progress bar and text sources, because they can't
+             * wait for the other processes to finish, otherwise it'll block
+             * the video thread
+             */
+            copy_mutex.lock();
+            copy = s;
+            copy_version++;
+            copy_mutex.unlock();
+
+            /* Process song data */
+            util::handle_outputs(s);
+            if (config::download_cover)
+                ref->handle_cover();
+            if (config::download_lyrics)
+                ref->handle_lyrics();
         }
+
+        /* Sleep until the next source is due, push sources and stopping
+         * the thread wake us up early */
+        auto now = now_ms();
+        auto next = scheduler.next_due();
+        uint64_t wait = next > now ? std::min<uint64_t>(next - now, MAX_SLEEP_MS) : 10;
+        if (!ref || next == 0)
+            wait = MAX_SLEEP_MS;
+
+        std::unique_lock<std::mutex> lock(wake_mutex);
+        wake_cv.wait_for(lock, std::chrono::milliseconds(wait), [] { return !thread_flag || !woken_sources.empty(); });
     }
     binfo("Query thread stopped.");
 }
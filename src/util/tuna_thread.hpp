@@ -23,16 +23,23 @@
 #include <mutex>
 #include <thread>
 
+class music_source;
+
 namespace tuna_thread {
 extern std::atomic<bool> thread_flag;
 extern std::mutex thread_mutex;
 extern std::mutex copy_mutex;
 extern std::thread thread_handle;
 extern song copy;
+/* Incremented with every new copy, protected by copy_mutex as well */
+extern uint64_t copy_version;
 
 bool start();
 
 void stop();
 
+/* Used by push sources to get refreshed before their next regular refresh */
+void wake(music_source* src);
+
 void thread_method();
 } // namespace thread
@@ -20,19 +20,25 @@
 #include "../query/music_source.hpp"
 #include "config.hpp"
 #include "constants.hpp"
+#include "cover_pipeline.hpp"
 #include "format.hpp"
+#include "rate_limiter.hpp"
 #include <QGuiApplication>
 #include <QScreen>
 
 #include <QDir>
 #include <QFile>
 #include <QJsonDocument>
+#include <QSet>
 #include <QTextStream>
 #include <ctime>
 #include <curl/curl.h>
 #include <obs-module.h>
 #include <sstream>
 #include <stdio.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <util/dstr.h>
 #include <util/platform.h>
 #if _WIN32
 #    include <windows.h>
@@ -132,8 +138,7 @@ bool download_cover(const QString& url)
     if (url == "n/a")
         return false;
     bool result = false;
-    auto output_path = config::cover_path;
-    auto tmp = output_path + ".tmp";
+    auto tmp = config::cover_path + ".tmp";
 
     static const int prefix_length =
 #if _WIN32
@@ -144,74 +149,41 @@ bool download_cover(const QString& url)
     if (url.startsWith("file://")) {
         // Don't use curl for local files
         QString new_cover_path = QUrl::fromPercentEncoding(url.mid(prefix_length).toUtf8());
-        QFile cover(new_cover_path);
 
-        if (!cover.exists()) {
+        if (!QFile::exists(new_cover_path)) {
             berr("Cover file '%s' does not exist", qt_to_utf8(new_cover_path));
             return false;
         }
-
-        QFile current(output_path);
-        current.remove();
-
-        if (!QFile::copy(new_cover_path, output_path)) {
-            berr("Couldn't copy cover file from '%s' to '%s'", qt_to_utf8(new_cover_path), qt_to_utf8(output_path));
-            return false;
-        }
-
-        return true;
+        return cover_pipeline::submit_file(new_cover_path);
     } else if (url.startsWith("data:image/")) {
         int comma = url.indexOf(',');
         if (comma == -1) {
-            berr("Failed to open file '%s' for writing", qt_to_utf8(output_path));
+            berr("Invalid data url for cover");
             return false;
         }
 
         QByteArray base64 = url.mid(comma + 1).toUtf8();
-        QByteArray image_data = QByteArray::fromBase64(base64);
-
-        QFile current(output_path);
-        current.remove();
-        if (!current.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
-            berr("Failed to open file '%s' for writing", qt_to_utf8(output_path));
-            return false;
-        }
-
-        if (current.write(image_data) != image_data.size()) {
-            berr("Failed to write all image data to '%s'", qt_to_utf8(output_path));
-            return false;
-        }
-
-        return true;
+        return cover_pipeline::submit(QByteArray::fromBase64(base64));
     }
 
     result = curl_download(qt_to_utf8(url), qt_to_utf8(tmp));
 
     if (!result) {
         berr("Failed to download image from '%s'", qt_to_utf8(url));
+        QFile::remove(tmp);
         return false;
     }
 
-    /* Replace cover only after download is done */
-    QFile current(output_path);
-    current.remove();
-
-    if (!QFile::rename(tmp, output_path)) {
-        berr("Couldn't rename temporary cover file");
-        return false;
-    }
-
+    result = cover_pipeline::submit_file(tmp);
     QFile::remove(tmp);
-    return true;
+    return result;
 }
 
 void reset_cover()
 {
-    auto path = config::cover_path;
-    QFile current(path);
-    current.remove();
-    if (!QFile::copy(config::cover_placeholder, path))
-        berr("Couldn't move placeholder cover");
+    /* Failures are logged once by the pipeline, this is called every time
+     * a source has no cover */
+    cover_pipeline::submit_placeholder();
 }
 
 void write_song(config::output& o, const QString& str)
@@ -249,6 +221,14 @@ void handle_outputs(const song& s)
     static QString tmp_text = "";
 
     for (auto& o : config::outputs) {
+        if (o.log_mode) {
+            /* The log gets one line per song, even if the format contains
+             * something like the progress, no need to format it otherwise */
+            if (s.get<int>(meta::STATUS) >= state_paused || s.identity() == o.last_identity)
+                continue;
+            o.last_identity = s.identity();
+        }
+
         tmp_text.clear();
         tmp_text = o.format;
         format::execute(tmp_text);
@@ -261,8 +241,6 @@ void handle_outputs(const song& s)
             tmp_text.replace("%s", " ");
             tmp_text.replace("%e", "\n");
         }
-        if (s.get<int>(meta::STATUS) >= state_paused && o.log_mode)
-            continue; /* No song playing text doesn't make sense in the log */
         write_song(o, tmp_text);
     }
 }
@@ -293,14 +271,49 @@ size_t write_callback(char* ptr, size_t size, size_t nmemb, std::string* str)
     return new_length;
 }
 
-QJsonDocument curl_get_json(const char* url)
+std::string get_header_value(const std::string& header, const char* name)
+{
+    auto name_length = strlen(name);
+    size_t line = 0;
+
+    /* Responses with redirects contain multiple headers, the last one wins */
+    std::string result;
+    while (line < header.length()) {
+        auto end = header.find('\n', line);
+        if (end == std::string::npos)
+            end = header.length();
+
+        if (end - line > name_length && header[line + name_length] == ':'
+            && astrcmpi_n(header.c_str() + line, name, name_length) == 0) {
+            auto value = header.substr(line + name_length + 1, end - line - name_length - 1);
+            auto first = value.find_first_not_of(" \t");
+            auto last = value.find_last_not_of(" \t\r");
+            result = first == std::string::npos ? "" : value.substr(first, last - first + 1);
+        }
+        line = end + 1;
+    }
+    return result;
+}
+
+QJsonDocument curl_get_json(const char* url, long* http_code_out)
 {
+    QJsonDocument doc;
+    if (http_code_out)
+        *http_code_out = -1;
+    if (!rate_limiter::acquire(utf8_to_qt(url))) {
+        bdebug("Waiting for rate limit before requesting json from %s", url);
+        return doc;
+    }
+
     CURL* curl = curl_easy_init();
     if (curl) {
-        std::string response {};
+        std::string response {}, header {};
+        long http_code = -1;
         curl_easy_setopt(curl, CURLOPT_URL, url);
         curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
         curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, write_callback);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, &header);
 #ifdef DEBUG
         curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
 #endif
@@ -309,17 +322,20 @@ QJsonDocument curl_get_json(const char* url)
         if (res != CURLE_OK) {
             berr("Couldn't fetch json from %s curl error: %s (%i)", url, curl_easy_strerror(res), res);
         } else {
+            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
             QJsonParseError err;
-            auto doc = QJsonDocument::fromJson(response.c_str(), &err);
+            doc = QJsonDocument::fromJson(response.c_str(), &err);
             if (doc.isNull())
                 berr("Couldn't parse json from url %s: %s", url, err.errorString().toStdString().c_str());
-            else
-                return doc;
         }
+        rate_limiter::report(utf8_to_qt(url), http_code, header);
         curl_easy_cleanup(curl);
+        if (http_code_out)
+            *http_code_out = http_code;
+    } else {
+        berr("curl_easy_init() failed when receiving json from %s", url);
     }
-    berr("curl_easy_init() failed when receiving json from %s", url);
-    return {};
+    return doc;
 }
 
 void set_thread_name(const char* name)
@@ -329,39 +345,39 @@ void set_thread_name(const char* name)
 
 QString remove_extensions(QString const& str)
 {
-    QString result = str;
-    if (CGET_BOOL(CFG_REMOVE_EXTENSIONS)) {
-        /* that's every single format supported by vlc, i think */
-        auto exts = { ".aac", ".ac3", ".adts", ".aif", ".aifc", ".aiff", ".amr", ".amv",
-            ".aob", ".aqt", ".asf", ".ass", ".asx", ".au", ".avc", ".avchd",
-            ".avi", ".ax", ".b4s", ".bdmv", ".cda", ".cdg", ".clpi", ".cue",
-            ".dash", ".div", ".divx", ".dts", ".dv", ".dvdmedia", ".f4v", ".flac",
-            ".flh", ".flv", ".gsm", ".gvi", ".gvp", ".h264", ".hdmov", ".ifo",
-            ".iso", ".it", ".jss", ".kmv", ".lrv", ".m1v", ".m2a", ".m2p",
-            ".m2t", ".m2ts", ".m3u", ".m3u8", ".m4a", ".m4b", ".m4p", ".m4v",
-            ".mid", ".mka", ".mkv", ".mlp", ".mod", ".moi", ".moov", ".mov",
-            ".mp1", ".mp2", /* yeah, as if anybody still uses mp2 */
-            ".mp2v", ".mp3", ".mp4", ".mp4.infovid", ".mp4v", ".mpa", ".mpc", ".mpe",
-            ".mpeg", ".mpeg1", ".mpeg4", ".mpg", ".mpg2", ".mpls", ".mpsub", ".mpv",
-            ".mpv2", ".mts", ".mxf", ".nsv", ".nuv", ".oga", ".ogg", ".ogm",
-            ".ogv", ".ogx", ".oma", ".opus", ".pjs", ".pss", ".ra", ".ram",
-            ".rec", ".rm", ".rmi", ".rmvb", ".rt", ".s3m", ".s3z", ".smi",
-            ".snd", ".spx", ".srt", ".sub", ".svi", ".tod", ".trp", ".ts",
-            ".tta", ".usf", ".vlc", ".vlt", ".vob", ".voc", ".vp6", ".vqf",
-            ".vro", ".vse", ".w64", ".wav", ".webm", ".wma", ".wmv", ".wv",
-            ".xa", ".xm", ".xspf", ".xvid", ".3g2", ".3ga", ".3gp", ".3gp2",
-            ".3gpp", ".3p2", ".261", ".3gp_128x96", ".axa", ".axv", ".cache-2", ".cache-3",
-            ".eac3", ".flvat", ".h260", ".mbv", ".mks", ".ml20", ".mp3a", ".mp4a",
-            ".mpeg2", ".mpg4", ".mpgv", ".thd", ".vfo", ".xavc", ".xwm", ".zab" };
-
-        for (const auto& ext : exts) {
-            if (result.endsWith(ext, Qt::CaseInsensitive)) {
-                result.chop(strlen(ext));
-                break;
-            }
+    /* that's every single format supported by vlc, i think */
+    static const QSet<QString> exts = { ".aac", ".ac3", ".adts", ".aif", ".aifc", ".aiff", ".amr", ".amv",
+        ".aob", ".aqt", ".asf", ".ass", ".asx", ".au", ".avc", ".avchd",
+        ".avi", ".ax", ".b4s", ".bdmv", ".cda", ".cdg", ".clpi", ".cue",
+        ".dash", ".div", ".divx", ".dts", ".dv", ".dvdmedia", ".f4v", ".flac",
+        ".flh", ".flv", ".gsm", ".gvi", ".gvp", ".h264", ".hdmov", ".ifo",
+        ".iso", ".it", ".jss", ".kmv", ".lrv", ".m1v", ".m2a", ".m2p",
+        ".m2t", ".m2ts", ".m3u", ".m3u8", ".m4a", ".m4b", ".m4p", ".m4v",
+        ".mid", ".mka", ".mkv", ".mlp", ".mod", ".moi", ".moov", ".mov",
+        ".mp1", ".mp2", /* yeah, as if anybody still uses mp2 */
+        ".mp2v", ".mp3", ".mp4", ".mp4.infovid", ".mp4v", ".mpa", ".mpc", ".mpe",
+        ".mpeg", ".mpeg1", ".mpeg4", ".mpg", ".mpg2", ".mpls", ".mpsub", ".mpv",
+        ".mpv2", ".mts", ".mxf", ".nsv", ".nuv", ".oga", ".ogg", ".ogm",
+        ".ogv", ".ogx", ".oma", ".opus", ".pjs", ".pss", ".ra", ".ram",
+        ".rec", ".rm", ".rmi", ".rmvb", ".rt", ".s3m", ".s3z", ".smi",
+        ".snd", ".spx", ".srt", ".sub", ".svi", ".tod", ".trp", ".ts",
+        ".tta", ".usf", ".vlc", ".vlt", ".vob", ".voc", ".vp6", ".vqf",
+        ".vro", ".vse", ".w64", ".wav", ".webm", ".wma", ".wmv", ".wv",
+        ".xa", ".xm", ".xspf", ".xvid", ".3g2", ".3ga", ".3gp", ".3gp2",
+        ".3gpp", ".3p2", ".261", ".3gp_128x96", ".axa", ".axv", ".cache-2", ".cache-3",
+        ".eac3", ".flvat", ".h260", ".mbv", ".mks", ".ml20", ".mp3a", ".mp4a",
+        ".mpeg2", ".mpg4", ".mpgv", ".thd", ".vfo", ".xavc", ".xwm", ".zab" };
+
+    /* ".mp4.infovid" is the only extension with two dots */
+    if (config::remove_file_extensions) {
+        int dot = str.lastIndexOf('.');
+        for (int i = 0; i < 2 && dot > 0; i++) {
+            if (exts.contains(str.mid(dot).toLower()))
+                return str.left(dot);
+            dot = str.lastIndexOf('.', dot - 1);
         }
     }
-    return result;
+    return str;
 }
 
 QString get_config_file_path_legacy(const char* name)
@@ -437,6 +453,23 @@ QString file_from_path(const QString& path)
     return splits.last();
 }
 
+bool get_file_identity(const QString& path, file_identity& id)
+{
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_wstat64(path.toStdWString().c_str(), &st) != 0)
+        return false;
+#else
+    struct stat st;
+    if (stat(qt_to_utf8(path), &st) != 0)
+        return false;
+#endif
+    id.size = int64_t(st.st_size);
+    id.mtime = int64_t(st.st_mtime);
+    id.inode = uint64_t(st.st_ino);
+    return true;
+}
+
 void create_config_folder()
 {
     BPtr<char> path = obs_module_config_path("");
@@ -22,6 +22,7 @@
 #include <QString>
 #include <obs-module.h>
 #include <stdint.h>
+#include <string>
 
 #define utf8_to_qt(_str) QString::fromUtf8(_str)
 #define qt_to_utf8(_str) _str.toUtf8().constData()
@@ -47,11 +48,23 @@ class QJsonDocument;
 
 namespace util {
 
+/* Identifies a version of a file on disk, used as a cache key for anything
+ * that is expensive to read from it */
+struct file_identity {
+    int64_t size = -1;
+    int64_t mtime = 0;
+    uint64_t inode = 0; /* Always zero on windows */
+
+    bool operator==(const file_identity& o) const { return size == o.size && mtime == o.mtime && inode == o.inode; }
+    bool operator!=(const file_identity& o) const { return !(*this == o); }
+};
+
 extern bool have_vlc_source;
 
 extern bool curl_download(const char* url, const char* path);
 
-QJsonDocument curl_get_json(const char* url);
+/* http_code is -1 if nothing was received */
+QJsonDocument curl_get_json(const char* url, long* http_code = nullptr);
 
 extern bool download_cover(const QString& url);
 
@@ -71,6 +84,10 @@ extern bool window_pos_valid(QRect rect);
 
 extern size_t write_callback(char* ptr, size_t size, size_t nmemb, std::string* str);
 
+/* Returns the trimmed value of a header field (case insensitive) from a raw
+ * response header collected with write_callback or an empty string */
+extern std::string get_header_value(const std::string& header, const char* name);
+
 /* Redirected from util/threading.h because it clashes with mongoose */
 extern void set_thread_name(const char* name);
 
@@ -78,6 +95,8 @@ extern QString remove_extensions(QString const& str);
 
 extern QString file_from_path(QString const& file);
 
+extern bool get_file_identity(QString const& path, file_identity& id);
+
 extern bool open_config(const char* name, QJsonDocument&);
 extern bool save_config(const char* name, const QJsonDocument&);
 
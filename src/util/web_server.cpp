@@ -18,11 +18,13 @@
 
 #include "web_server.hpp"
 #include "../plugin-macros.generated.h"
+#include "../query/music_source.hpp"
 #include "config.hpp"
+#include "constants.hpp"
+#include "cover_pipeline.hpp"
 #include "tuna_thread.hpp"
 #include "utility.hpp"
 #include <QDateTime>
-#include <QFile>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <ctime>
@@ -84,8 +86,11 @@ static void handle_post(const httplib::Request& req, httplib::Response& res)
 
         if (data.isObject()) {
             auto const obj = data.toObject();
-            std::lock_guard<std::mutex> lock(current_song_mutex);
-            current_song.from_json(obj);
+            {
+                std::lock_guard<std::mutex> lock(current_song_mutex);
+                current_song.from_json(obj);
+            }
+            tuna_thread::wake(music_sources::get<music_source>(S_SOURCE_WEB).get());
         }
     } else {
         bwarn("Error while parsing JSON received via POST: %s", qt_to_utf8(err.errorString()));
@@ -109,6 +114,53 @@ static void handle_post(const httplib::Request& req, httplib::Response& res)
     res.status = 200;
 }
 
+/* Clients are expected to revalidate, which is cheap since the ETag only
+ * changes with the cover */
+static void send_cover(const httplib::Request& req, httplib::Response& res, cover_pipeline::variant const& v)
+{
+    res.set_header("ETag", v.etag);
+    res.set_header("Cache-Control", "no-cache");
+    if (req.get_header_value("If-None-Match") == v.etag) {
+        res.status = 304;
+        return;
+    }
+    res.set_content(v.data.constData(), size_t(v.data.size()), v.mime);
+    res.status = 200;
+}
+
+/* Serves the pre-encoded cover variants, size is either a number,
+ * "original" or "blur" */
+static void handle_cover_get(const httplib::Request& req, httplib::Response& res)
+{
+    res.set_header("Access-Control-Allow-Origin", "*");
+    res.set_header("Server", "tuna/" PLUGIN_VERSION);
+
+    auto const& name = req.matches[1].str();
+    int size = 0;
+    cover_pipeline::variant v;
+    if (name == "blur") {
+        if (!cover_pipeline::get_blurred(v)) {
+            res.set_content("404 Not Found: Blurred covers are disabled", "text/plain");
+            res.status = 404;
+            return;
+        }
+    } else if (name != "original") {
+        size = atoi(name.c_str());
+        if (size <= 0) {
+            res.set_content("400 Bad Request: Invalid cover size", "text/plain");
+            res.status = 400;
+            return;
+        }
+    }
+
+    if (v.data.isEmpty() && !cover_pipeline::get_variant(size, v)) {
+        res.set_content("404 Not Found: No cover available", "text/plain");
+        res.status = 404;
+        return;
+    }
+    send_cover(req, res, v);
+}
+
 bool start()
 {
     if (server && server->is_running() && server->is_valid())
@@ -130,21 +182,19 @@ bool start()
         res.set_header("Server", "tuna/" PLUGIN_VERSION);
         res.set_content(date, "text/plain");
     });
-    server->Get("/cover.png", [](const httplib::Request&, httplib::Response& res) {
-        QFile f(config::cover_path);
-        if (f.open(QIODevice::ReadOnly)) {
-            auto data = f.readAll();
-            res.set_content(data, data.length(), "image/png");
-            res.set_header("Access-Control-Allow-Origin", "*");
-            res.set_header("Cache-Control", "no-cache");
-            res.set_header("Server", "tuna/" PLUGIN_VERSION);
-            res.status = 200;
-        } else {
-            res.set_content("500 Internal Server Error: Couldn't open cover file", "text/plain");
-            res.set_header("Server", "tuna/" PLUGIN_VERSION);
-            res.status = 500;
+    server->Get("/cover.png", [](const httplib::Request& req, httplib::Response& res) {
+        /* Served from memory, writing the cover file is optional */
+        res.set_header("Access-Control-Allow-Origin", "*");
+        res.set_header("Server", "tuna/" PLUGIN_VERSION);
+        cover_pipeline::variant v;
+        if (!cover_pipeline::get_original(v)) {
+            res.set_content("404 Not Found: No cover available", "text/plain");
+            res.status = 404;
+            return;
         }
+        send_cover(req, res, v);
     });
+    server->Get(R"(/cover/(\w+))", handle_cover_get);
     server->Get("/", handle_info_get);
     server->Post("/", handle_post);
 
@@ -13,3 +13,9 @@
 
 void GetWindowList(std::vector<std::string>& windows);
 void GetWindowAndExeList(std::vector<std::pair<std::string, std::string>>& list);
+
+/* Only fetches the titles of windows that belong to this executable */
+void GetWindowTitlesForExe(const std::string& exe, std::vector<std::string>& titles);
+
+/* Shuts down background tracking of windows on platforms that use it */
+void StopWindowTracking();
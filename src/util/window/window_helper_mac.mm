@@ -81,3 +81,21 @@ void GetWindowAndExeList(vector<pair<string, string>> &list) {
     }
   }
 }
+
+void GetWindowTitlesForExe(const string &exe, vector<string> &titles) {
+  @autoreleasepool {
+    NSString *owner = [NSString stringWithUTF8String:exe.c_str()];
+    for (NSDictionary *d in enumerate_windows()) {
+      if (![owner isEqualToString:d[OWNER_NAME]])
+        continue;
+      bool ok = false;
+      auto pair = create_pair(d[OWNER_NAME], d[WINDOW_NAME], ok);
+      if (ok)
+        titles.emplace_back(pair.second);
+    }
+  }
+}
+
+void StopWindowTracking() {
+  /* Windows are queried on demand */
+}
@@ -1,11 +1,17 @@
+#include "../utility.hpp"
 #include "window_helper.hpp"
 #include <X11/Xatom.h>
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
+#include <atomic>
 #include <list>
+#include <mutex>
 #include <obs-module.h>
 #include <string>
+#include <sys/select.h>
+#include <thread>
 #include <unistd.h>
+#include <unordered_map>
 #include <util/platform.h>
 #include <utility>
 #include <vector>
@@ -25,10 +31,37 @@ Display* disp()
     return xdisplay;
 }
 
-bool ewmhIsSupported()
+/* Atoms are the same for every connection to the server, so they're only
+ * interned once */
+struct Atoms {
+    Atom netSupportingWmCheck;
+    Atom netClientList;
+    Atom netWmName;
+    Atom netWmPid;
+};
+
+static Atoms atoms;
+static once_flag atomsOnce;
+
+const Atoms& getAtoms()
+{
+    call_once(atomsOnce, [] {
+        const char* names[] = { "_NET_SUPPORTING_WM_CHECK", "_NET_CLIENT_LIST", "_NET_WM_NAME", "_NET_WM_PID" };
+        Atom values[4] = {};
+        XInternAtoms(disp(), (char**)names, 4, false, values);
+        atoms = { values[0], values[1], values[2], values[3] };
+    });
+    return atoms;
+}
+
+bool ewmhIsSupported(Display* display)
 {
-    Display* display = disp();
-    Atom netSupportingWmCheck = XInternAtom(display, "_NET_SUPPORTING_WM_CHECK", true);
+    /* Once a window manager with ewmh support is found, assume it stays */
+    static atomic<bool> supported { false };
+    if (supported)
+        return true;
+
+    Atom netSupportingWmCheck = getAtoms().netSupportingWmCheck;
     Atom actualType;
     int format = 0;
     unsigned long num = 0, bytes = 0;
@@ -59,14 +92,15 @@ bool ewmhIsSupported()
         }
     }
 
-    return ewmh_window != 0;
+    supported = ewmh_window != 0;
+    return supported;
 }
 
-list<Window> getTopLevelWindows()
+list<Window> getTopLevelWindows(Display* display)
 {
     list<Window> res;
 
-    if (!ewmhIsSupported()) {
+    if (!ewmhIsSupported(display)) {
         blog(LOG_WARNING, "Unable to query window list "
                           "because window manager "
                           "does not support extended "
@@ -74,16 +108,16 @@ list<Window> getTopLevelWindows()
         return res;
     }
 
-    Atom netClList = XInternAtom(disp(), "_NET_CLIENT_LIST", true);
+    Atom netClList = getAtoms().netClientList;
     Atom actualType;
     int format;
     unsigned long num, bytes;
     Window* data = 0;
 
-    for (int i = 0; i < ScreenCount(disp()); ++i) {
-        Window rootWin = RootWindow(disp(), i);
+    for (int i = 0; i < ScreenCount(display); ++i) {
+        Window rootWin = RootWindow(display, i);
 
-        int status = XGetWindowProperty(disp(), rootWin, netClList, 0L, ~0L, false, AnyPropertyType, &actualType,
+        int status = XGetWindowProperty(display, rootWin, netClList, 0L, ~0L, false, AnyPropertyType, &actualType,
             &format, &num, &bytes, (uint8_t**)&data);
 
         if (status != Success) {
@@ -102,18 +136,17 @@ list<Window> getTopLevelWindows()
     return res;
 }
 
-string getWindowAtom(Window win, const char* atom)
+string getWindowAtom(Display* display, Window win, Atom atom)
 {
-    Atom netWmName = XInternAtom(disp(), atom, false);
     int n;
     char** list = 0;
     XTextProperty tp;
     string res = "unknown";
 
-    XGetTextProperty(disp(), win, &tp, netWmName);
+    XGetTextProperty(display, win, &tp, atom);
 
     if (!tp.nitems)
-        XGetWMName(disp(), win, &tp);
+        XGetWMName(display, win, &tp);
 
     if (!tp.nitems)
         return "error";
@@ -121,7 +154,7 @@ string getWindowAtom(Window win, const char* atom)
     if (tp.encoding == XA_STRING) {
         res = (char*)tp.value;
     } else {
-        int ret = XmbTextPropertyToTextList(disp(), &tp, &list, &n);
+        int ret = XmbTextPropertyToTextList(display, &tp, &list, &n);
 
         if (ret >= Success && n > 0 && *list) {
             res = *list;
@@ -139,59 +172,353 @@ string getWindowAtom(Window win, const char* atom)
     return res;
 }
 
-inline string getWindowName(Window win)
+inline string getWindowName(Display* display, Window win)
 {
-    return getWindowAtom(win, "_NET_WM_NAME");
+    return getWindowAtom(display, win, getAtoms().netWmName);
 }
 
-inline string getWindowClass(Window win)
+int getWindowPid(Display* display, Window win)
 {
-    return getWindowAtom(win, "WM_CLASS");
-}
-
-inline string getWindowExe(Window win)
-{
-    Atom windowPID = XInternAtom(disp(), "_NET_WM_PID", true);
+    Atom windowPID = getAtoms().netWmPid;
     Atom actualType;
     int format;
     unsigned long num, bytes;
     unsigned char* propPID = nullptr;
+    int pid = 0;
     if (windowPID != None) {
-        if (XGetWindowProperty(disp(), win, windowPID, 0, 1, False, XA_CARDINAL, &actualType, &format, &num, &bytes,
+        if (XGetWindowProperty(display, win, windowPID, 0, 1, False, XA_CARDINAL, &actualType, &format, &num, &bytes,
                 &propPID)
             == Success) {
             if (propPID != nullptr) {
-                int pidInt = *((int*)propPID);
-                auto pid_str = "/proc/" + to_string(pidInt) + "/exe";
+                if (num > 0)
+                    pid = *((int*)propPID);
                 XFree(propPID);
-                char exe[1024];
-                memset(exe, 0, 1024);
-                if (readlink(pid_str.c_str(), exe, 1024) > 0) {
-                    return exe;
-                }
             }
         }
     }
+    return pid;
+}
+
+string getProcessExe(int pid)
+{
+    auto pid_str = "/proc/" + to_string(pid) + "/exe";
+    char exe[1024];
+    memset(exe, 0, 1024);
+    if (readlink(pid_str.c_str(), exe, 1023) > 0)
+        return exe;
     return "";
 }
 
+/* Start time of a process in clock ticks since boot, used to tell whether
+ * a pid was reused by a different process */
+unsigned long long getProcessStartTime(int pid)
+{
+    auto stat_str = "/proc/" + to_string(pid) + "/stat";
+    FILE* f = fopen(stat_str.c_str(), "r");
+    if (!f)
+        return 0;
+
+    char buf[1024];
+    size_t len = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[len] = '\0';
+
+    /* The process name can contain spaces, so fields are counted from the
+     * closing parenthesis, start time is field 22 */
+    char* p = strrchr(buf, ')');
+    if (!p)
+        return 0;
+    for (int field = 2; field < 22 && p; field++)
+        p = strchr(p + 1, ' ');
+    return p ? strtoull(p + 1, nullptr, 10) : 0;
+}
+
+inline string getWindowExe(Display* display, Window win)
+{
+    int pid = getWindowPid(display, win);
+    return pid > 0 ? getProcessExe(pid) : "";
+}
+
+/* Keeps track of all top level windows and their titles on its own
+ * connection. The root windows report changes to _NET_CLIENT_LIST and every
+ * client window reports changes to its name through PropertyNotify, so
+ * nothing has to be queried when the window list is requested */
+namespace watcher {
+static thread handle;
+static atomic<bool> running { false };
+static atomic<bool> failed { false };
+static Display* display = nullptr;
+
+/* Titles are fetched as soon as a window reports a new name and exe paths
+ * are resolved once per window since the owner of a window doesn't change */
+struct WindowInfo {
+    string title;
+    string exe;
+    int pid = 0;
+};
+
+struct ProcessInfo {
+    string exe;
+    unsigned long long startTime;
+};
+
+/* Only the watcher thread changes the windows, so it reads them without the
+ * lock. Everybody else only copies the strings with the lock held */
+static mutex windowsMutex;
+static vector<Window> windowOrder;
+static unordered_map<Window, WindowInfo> windowInfo;
+static unordered_map<int, ProcessInfo> processes; /* Watcher thread only */
+
+/* Windows can be destroyed at any point, so errors caused by requests for
+ * them are expected on our connection. The error handler is global, so it's
+ * only replaced while these requests are made and errors of other
+ * connections are passed on */
+static XErrorHandler trapPrevHandler = nullptr;
+
+static int trapHandler(Display* d, XErrorEvent* e)
+{
+    if (d == display)
+        return 0;
+    return trapPrevHandler ? trapPrevHandler(d, e) : 0;
+}
+
+class ErrorTrap {
+public:
+    ErrorTrap() { trapPrevHandler = XSetErrorHandler(trapHandler); }
+    ~ErrorTrap()
+    {
+        /* Errors are only reported once the requests were processed */
+        XSync(display, false);
+        XSetErrorHandler(trapPrevHandler);
+    }
+};
+
+static string resolveExe(int pid)
+{
+    if (pid <= 0)
+        return "";
+
+    /* A new window of a known process only needs a check whether the pid
+     * still belongs to the same process */
+    auto startTime = getProcessStartTime(pid);
+    auto it = processes.find(pid);
+    if (it == processes.end() || it->second.startTime != startTime)
+        it = processes.insert_or_assign(pid, ProcessInfo { getProcessExe(pid), startTime }).first;
+    return it->second.exe;
+}
+
+static void updateClientList()
+{
+    unordered_map<Window, WindowInfo> info;
+    vector<Window> order;
+    {
+        ErrorTrap trap;
+        auto windows = getTopLevelWindows(display);
+        order.reserve(windows.size());
+        for (const auto& window : windows) {
+            auto it = windowInfo.find(window);
+            if (it != windowInfo.end()) {
+                info[window] = it->second;
+            } else {
+                XSelectInput(display, window, PropertyChangeMask);
+                auto& added = info[window];
+                added.pid = getWindowPid(display, window);
+                added.title = getWindowName(display, window);
+            }
+            order.push_back(window);
+        }
+
+        /* Whatever is left was destroyed or at least removed from the list */
+        for (const auto& window : windowInfo) {
+            if (info.count(window.first) == 0)
+                XSelectInput(display, window.first, NoEventMask);
+        }
+    }
+
+    for (auto& window : info) {
+        if (windowInfo.count(window.first) == 0)
+            window.second.exe = resolveExe(window.second.pid);
+    }
+
+    /* Drop processes that don't own any windows anymore */
+    for (auto it = processes.begin(); it != processes.end();) {
+        bool used = false;
+        for (const auto& window : info) {
+            if (window.second.pid == it->first) {
+                used = true;
+                break;
+            }
+        }
+        it = used ? next(it) : processes.erase(it);
+    }
+
+    lock_guard<mutex> lock(windowsMutex);
+    windowInfo = std::move(info);
+    windowOrder = std::move(order);
+}
+
+static void updateTitle(Window window)
+{
+    auto it = windowInfo.find(window);
+    if (it == windowInfo.end())
+        return;
+
+    string title;
+    {
+        ErrorTrap trap;
+        title = getWindowName(display, window);
+    }
+    lock_guard<mutex> lock(windowsMutex);
+    it->second.title = std::move(title);
+}
+
+static void threadMethod()
+{
+    util::set_thread_name("tuna-x11");
+    const auto& a = getAtoms();
+
+    {
+        ErrorTrap trap;
+        for (int i = 0; i < ScreenCount(display); ++i)
+            XSelectInput(display, RootWindow(display, i), PropertyChangeMask);
+    }
+    updateClientList();
+
+    int fd = ConnectionNumber(display);
+    while (running) {
+        while (XPending(display) > 0) {
+            XEvent event;
+            XNextEvent(display, &event);
+            if (event.type != PropertyNotify)
+                continue;
+
+            const auto& p = event.xproperty;
+            if (p.atom == a.netClientList)
+                updateClientList();
+            else if (p.atom == a.netWmName || p.atom == XA_WM_NAME)
+                updateTitle(p.window);
+        }
+
+        /* Wake up regularly so that shutting down doesn't block */
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(fd, &fds);
+        timeval timeout { 0, 100 * 1000 };
+        select(fd + 1, &fds, nullptr, nullptr, &timeout);
+    }
+
+    XCloseDisplay(display);
+    display = nullptr;
+}
+
+bool start()
+{
+    if (running)
+        return true;
+    if (failed)
+        return false;
+
+    if (!disp() || !ewmhIsSupported(disp())) {
+        failed = true;
+        return false;
+    }
+
+    display = XOpenDisplay(nullptr);
+    if (!display) {
+        blog(LOG_WARNING, "Failed to open X connection for window tracking");
+        failed = true;
+        return false;
+    }
+
+    running = true;
+    handle = thread(threadMethod);
+    return true;
+}
+
+void stop()
+{
+    if (!running)
+        return;
+    running = false;
+    if (handle.joinable())
+        handle.join();
+}
+
+void getTitles(vector<string>& titles)
+{
+    lock_guard<mutex> lock(windowsMutex);
+    titles.reserve(windowOrder.size());
+    for (const auto& window : windowOrder)
+        titles.emplace_back(windowInfo.at(window).title);
+}
+
+void getTitlesAndExes(vector<pair<string, string>>& list)
+{
+    lock_guard<mutex> lock(windowsMutex);
+    for (const auto& window : windowOrder) {
+        const auto& info = windowInfo.at(window);
+        if (!info.exe.empty())
+            list.emplace_back(info.exe, info.title);
+    }
+}
+
+void getTitlesForExe(const string& exe, vector<string>& titles)
+{
+    lock_guard<mutex> lock(windowsMutex);
+    for (const auto& window : windowOrder) {
+        const auto& info = windowInfo.at(window);
+        if (info.exe == exe)
+            titles.emplace_back(info.title);
+    }
+}
+} // namespace watcher
+
 } // namespace x11util
 
 void GetWindowList(vector<string>& windows)
 {
-    list<Window> top_level = x11util::getTopLevelWindows();
+    if (x11util::watcher::start()) {
+        x11util::watcher::getTitles(windows);
+        return;
+    }
+
+    list<Window> top_level = x11util::getTopLevelWindows(x11util::disp());
     for (const auto& window : top_level) {
-        windows.emplace_back(x11util::getWindowName(window));
+        windows.emplace_back(x11util::getWindowName(x11util::disp(), window));
     }
 }
 
 void GetWindowAndExeList(vector<pair<string, string>>& list)
 {
-    auto top_level = x11util::getTopLevelWindows();
+    if (x11util::watcher::start()) {
+        x11util::watcher::getTitlesAndExes(list);
+        return;
+    }
+
+    auto top_level = x11util::getTopLevelWindows(x11util::disp());
     for (const auto& window : top_level) {
-        auto exe = x11util::getWindowExe(window);
+        auto exe = x11util::getWindowExe(x11util::disp(), window);
         if (!exe.empty()) {
-            list.emplace_back(pair<string, string>(exe, x11util::getWindowName(window)));
+            list.emplace_back(pair<string, string>(exe, x11util::getWindowName(x11util::disp(), window)));
         }
     }
 }
+
+void GetWindowTitlesForExe(const string& exe, vector<string>& titles)
+{
+    if (x11util::watcher::start()) {
+        x11util::watcher::getTitlesForExe(exe, titles);
+        return;
+    }
+
+    auto top_level = x11util::getTopLevelWindows(x11util::disp());
+    for (const auto& window : top_level) {
+        if (x11util::getWindowExe(x11util::disp(), window) == exe)
+            titles.emplace_back(x11util::getWindowName(x11util::disp(), window));
+    }
+}
+
+void StopWindowTracking()
+{
+    x11util::watcher::stop();
+}
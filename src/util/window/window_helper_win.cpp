@@ -94,3 +94,20 @@ void GetWindowAndExeList(std::vector<std::pair<std::string, std::string>>& list)
         window = GetNextWindow(window, GW_HWNDNEXT);
     }
 }
+
+void GetWindowTitlesForExe(const std::string& exe, std::vector<std::string>& titles)
+{
+    HWND window = GetWindow(GetDesktopWindow(), GW_CHILD);
+
+    while (window) {
+        std::string title, window_exe;
+        if (WindowValid(window) && GetWindowExe(window, window_exe) && window_exe == exe && GetWindowTitle(window, title))
+            titles.emplace_back(title);
+        window = GetNextWindow(window, GW_HWNDNEXT);
+    }
+}
+
+void StopWindowTracking()
+{
+    /* Windows are queried on demand */
+}